@@ -1,11 +1,12 @@
 /*
     module  : 32syrecc.c
-    version : 1.3
-    date    : 08/17/23
+    version : 1.20
+    date    : 10/17/26
 */
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <inttypes.h>
 #include "32syreci.h"
@@ -25,16 +26,51 @@
 #define MINCHR	33
 
 /*
-    maximum size of the symbol table. There will be an error when the table is
-    exceeded.
+    perfect hash of a keyword of length n; no two keywords have the same hash.
 */
-#define MAXSYM	100
+#define KEYHASH(s, n)	(((n) + 4 * (s)[0] + 5 * (s)[(n) - 1] + (s)[1]) & 63)
 
 /*
-    maximum size of the instruction table. The size is taken from 32syreci.c
+    initial size of the source buffer. The buffer grows when needed.
+*/
+#define MAXSRC	65536
+
+/*
+    initial number of chains in the symbol table, and size of the blocks that
+    hold the symbols. The table doubles when it has more symbols than chains.
+*/
+#define MINSYM	64
+#define ARENA	65536
+
+/*
+    highest register number, as topregister in 32syreci.
+*/
+#define MAXREG	7
+
+/*
+    an instruction that is removed when the code array is rebuilt.
+*/
+#define nop	((operator)-1)
+
+/*
+    the key of a variable in the facts of constant propagation; registers
+    have keys 0 .. 15. GLOBALS is the set of all global variables in a word.
+*/
+#define VARKEY(local, adr)	(16 + 2 * (adr) + (local))
+#define GLOBALS			0x5555555555555555
+
+/*
+    initial size of the instruction table. The table grows when needed, up to
+    the largest jump target that fits in an instruction.
 */
 #define MAXPRG	200
 
+/*
+    largest procedure, in instructions, that is inlined at every call; a
+    procedure that is called once is inlined whatever its size.
+*/
+#define INLINE	24
+
 /*
     Symbol types. The numbers 0-18 are keywords. Valid single characters are:
     ( ) * + - / . ; < = >
@@ -65,17 +101,112 @@ enum {
     typ_assign,		/* := */
     typ_unequal,	/* <> */
     typ_lesseql,	/* <= */
-    typ_moreeql		/* >= */
+    typ_moreeql,	/* >= */
+    typ_eof		/* end of the file */
 };
 
 /* ------------------------------- T Y P E S ------------------------------- */
 
+/*
+    code_t is an instruction with wide operands; dump packs it in a file. line
+    is the source line and proc the procedure the instruction comes from.
+*/
+typedef struct code_t {
+    operator op;
+    int64_t adr1, adr2;
+    int line, proc;
+} code_t;
+
+/*
+    insert_t adds count instructions before code[at], at position start after
+    the code array is rebuilt.
+*/
+typedef struct insert_t {
+    int at, lo, hi, inside, count, start;
+    code_t ins[MAXREG + 1];
+} insert_t;
+
+/*
+    var_t is a variable that is used in a loop and the register that holds it,
+    or -1.
+*/
+typedef struct var_t {
+    int local, count, dirty, reg;
+    int64_t adr;
+} var_t;
+
+/*
+    block_t is a basic block of the instructions first .. last, with at most
+    two successors, or -1. An entry block is the start of a procedure.
+*/
+typedef struct block_t {
+    int first, last, succ[2], entry;
+} block_t;
+
+/*
+    fact_t tells that a register or variable has a known value. A state_t is
+    a list of facts ordered by key; it is seen when the block can be reached.
+*/
+typedef struct fact_t {
+    int64_t key, val;
+} fact_t;
+
+typedef struct state_t {
+    fact_t *fact;
+    int count, seen;
+} state_t;
+
+/*
+    expr_t gives value number vn to the expression op x y, in the basic block
+    of generation gen.
+*/
+typedef struct expr_t {
+    operator op;
+    int64_t x, y;
+    int vn, gen;
+} expr_t;
+
 typedef struct symbol_t {
-    char *name;
-    int type,	/* 0=boolean, 1=integer, >=2 address */
+    struct symbol_t *next;	/* next symbol in the same chain */
+    unsigned hash;
+    int kind,	/* 0=global, 1=local, 2=procedure */
+	adr,	/* offset of a variable */
+	type,	/* 0=boolean, 1=integer, >=2 address */
 	parm;	/* number of local variables */
+    char name[];
 } symbol_t;
 
+/*
+    proc_t is a procedure that is being inlined: its instructions, with jumps
+    relative to the first one and calls by procedure number, its frame before
+    and after inlining, the number of calls to it, and whether it can call
+    itself. state is 1 while it is inlined, and 2 after.
+*/
+typedef struct proc_t {
+    code_t *body;
+    int count, locals, frame, calls, recursive, state;
+} proc_t;
+
+/*
+    pure_t is what a procedure does with the global variables: the sets of
+    those that it can read before writing them, that it can write, and that
+    it writes whenever it returns. It is impure when it writes output, halts,
+    or reads a local variable that it may not have written.
+*/
+typedef struct pure_t {
+    int entry, impure;
+    uint64_t *reads, *writes, *surely;
+} pure_t;
+
+/*
+    scan_t is the position of the scanner, with the symbol that was read last.
+*/
+typedef struct scan_t {
+    char *cursor, variable[MAXVAR + 1];
+    int linenum, symbol;
+    int64_t number;
+} scan_t;
+
 /* --------------------------- V A R I A B L E S --------------------------- */
 
 char *keywords[] = {
@@ -107,255 +238,375 @@ char *keywords[] = {
     ">="
 };
 
-int code_idx = 1;
-instruction code[MAXPRG];
+/*
+    keyword index for each value of KEYHASH, or -1.
+*/
+signed char keyhash[64] = {
+    -1, -1, 17,  6, -1,  5, -1, -1, -1, -1,  8,  9, 18, -1, -1, -1,
+    -1, -1, -1, 10, -1, -1, -1, -1,  1, -1, 11, -1, -1, -1, -1, -1,
+    -1, -1, 15, -1,  2, -1, -1, -1, -1,  0, 13, -1,  3, -1, 12, -1,
+    -1, -1, -1, -1, 14, -1, -1,  7, -1,  4, -1, -1, -1, -1, -1, 16
+};
+
+/* the source text, ending in a null character, and the scan position */
+char *source, *cursor;
+
+int code_idx = 1, code_max;
+code_t *code;
+
+/* source line of the statement that is being compiled */
+int codeline = 1;
+
+/* names of the procedures; the last one is the current procedure */
+char **procnames;
+int procname_idx, procname_max;
+
+/*
+    The symbol table has a chain per hash value, with the newest symbol first.
+    The symbols that are in scope are also kept in order of declaration, so
+    that leaving a scope can unlink them from the front of their chains.
+*/
+symbol_t **symtab, **symbols;
+int symtab_max, sym_idx, sym_max, global_idx, local_idx;
 
-int function_idx, global_idx, local_idx;
-symbol_t functions[MAXSYM], globals[MAXSYM], locals[MAXSYM];
+/* free space in the current block of the arena */
+char *arena;
+size_t arena_left;
 
 char val_variable[MAXVAR + 1];
-int linenum = 1, symbol, val_number;
+int linenum = 1, symbol;
+int64_t val_number;
 
 /* next available register number */
 int regnum;
 
+/* jump targets, and the last instruction that a jump was patched to */
+char *target;
+int patched;
+
+/* the jumps of a parenthesized condition, and the register of its value */
+int pending[2], pendreg;
+
+/* registers read after each instruction, and registers that hold variables */
+int *live, homes;
+
+/* basic blocks, and the block of each instruction */
+block_t *blocks;
+int nblocks, *blockof;
+
+/* value numbers of expressions */
+expr_t *exprs;
+int nexprs, generation, values;
+
+/* optimization level, number of errors, and reporting of inlining */
+int level = 2, errors, verbose;
+
 /* --------------------------- F U N C T I O N S --------------------------- */
 
 /*
     error prints a message to stderr, while reporting what was seen instead.
+    After the end of the file only that is reported, not what follows from it.
 */
 void error(char *msg)
 {
+    errors++;
+    if (symbol == typ_eof)
+	return;
     fprintf(stderr, "%d: %s\nsymbol=", linenum, msg);
     if (symbol <= MAXIDX)
 	fprintf(stderr, "%s", keywords[symbol]);
     else
 	fprintf(stderr, symbol >= MINCHR ? "%c" : "%d", symbol);
-    fprintf(stderr, ", variable=%s, number=%d\n", val_variable, val_number);
+    fprintf(stderr, ", variable=%s, number=%" PRId64 "\n", val_variable,
+	    val_number);
 }
 
+void materialize(int *, int);	/* forward */
+
+/*
+    enterprog adds an instruction to the code array. The value of a
+    parenthesized condition, that is used as an operand, is computed first.
+*/
 void enterprog(operator op, int64_t adr1, int64_t adr2)
 {
-    if (++code_idx >= MAXPRG) {
-	error("Exceeding code array");
-	return;
+    int jumps[2];
+
+    if (pending[0] || pending[1]) {
+	jumps[0] = pending[0];
+	jumps[1] = pending[1];
+	pending[0] = pending[1] = 0;
+	materialize(jumps, pendreg);
+    }
+    if (++code_idx >= code_max) {
+	if (code_idx > MAXADR1) {
+	    error("Exceeding code array");
+	    return;
+	}
+	code = realloc(code, (code_max *= 2) * sizeof(code_t));
     }
     code[code_idx].op = op;
     code[code_idx].adr1 = adr1;
     code[code_idx].adr2 = adr2;
+    code[code_idx].line = codeline;
+    code[code_idx].proc = procname_idx - 1;
 }
 
-void enterglobal(int type)
+void enterprocname(char *name)
 {
-    if (global_idx >= MAXSYM) {
-	error("Exceeding global symbol table");
-	return;
-    }
-    globals[global_idx].name = strdup(val_variable);
-    globals[global_idx].type = type;
-    globals[global_idx].parm = 0;
-    global_idx++;
+    if (procname_idx == procname_max)
+	procnames = realloc(procnames, (procname_max = procname_max ?
+				2 * procname_max : 16) * sizeof(char *));
+    procnames[procname_idx++] = name;
 }
 
-void enterfunction(int type)
+/*
+    allot returns memory from the arena. The memory is never freed.
+*/
+void *allot(size_t size)
 {
-    if (function_idx >= MAXSYM) {
-	error("Exceeding function symbol table");
-	return;
+    void *ptr;
+
+    size = (size + 7) & ~(size_t)7;
+    if (size > arena_left) {
+	arena_left = size > ARENA ? size : ARENA;
+	arena = malloc(arena_left);
     }
-    functions[function_idx].name = strdup(val_variable);
-    functions[function_idx].type = type;
-    functions[function_idx].parm = 0;
-    function_idx++;
+    ptr = arena;
+    arena += size;
+    arena_left -= size;
+    return ptr;
 }
 
-void enterlocal(int type)
+unsigned hashname(char *str)
 {
-    if (local_idx >= MAXSYM) {
-	error("Exceeding local symbol table");
-	return;
-    }
-    locals[local_idx].name = strdup(val_variable);
-    locals[local_idx].type = type;
-    locals[local_idx].parm = 0;
-    local_idx++;
+    unsigned hash = 2166136261u;
+
+    while (*str)
+	hash = (hash ^ (unsigned char)*str++) * 16777619u;
+    return hash;
 }
 
 /*
-    lookup locates a symbol in the symbol table. Found = 1 means found in local
-    table; found = 0 means found in global table; found = 2 means found in
-    function table, and found = -1 means not found at all.
+    linksym puts a symbol in front of its chain.
 */
-int lookup(char *str, int *found, int *type)
+void linksym(symbol_t *sym)
+{
+    symbol_t **chain = &symtab[sym->hash & (symtab_max - 1)];
+
+    sym->next = *chain;
+    *chain = sym;
+}
+
+/*
+    enter adds the symbol in val_variable to the current scope.
+*/
+symbol_t *enter(int kind, int adr, int type)
 {
     int i;
+    symbol_t *sym;
 
-    for (i = local_idx - 1; i >= 0; i--)
-	if (!strcmp(str, locals[i].name)) {
-	    *found = 1;
-	    *type = locals[i].type;
-	    return i;
-	}
-    for (i = global_idx - 1; i >= 0; i--)
-	if (!strcmp(str, globals[i].name)) {
-	    *found = 0;
-	    *type = globals[i].type;
-	    return i;
-	}
-    for (i = function_idx - 1; i >= 0; i--)
-	if (!strcmp(str, functions[i].name)) {
-	    *found = 2;
-	    *type = functions[i].type;
-	    return i;
-	}
-    *found = -1;
-    return -1;
+    if (sym_idx >= sym_max) {
+	sym_max = sym_max ? 2 * sym_max : MINSYM;
+	symbols = realloc(symbols, sym_max * sizeof(symbol_t *));
+    }
+    if (sym_idx >= symtab_max) {
+	free(symtab);
+	symtab_max = sym_max;
+	symtab = calloc(symtab_max, sizeof(symbol_t *));
+	for (i = 0; i < sym_idx; i++)
+	    linksym(symbols[i]);
+    }
+    sym = allot(sizeof(symbol_t) + strlen(val_variable) + 1);
+    strcpy(sym->name, val_variable);
+    sym->hash = hashname(sym->name);
+    sym->kind = kind;
+    sym->adr = adr;
+    sym->type = type;
+    sym->parm = 0;
+    linksym(sym);
+    return symbols[sym_idx++] = sym;
+}
+
+/*
+    closescope removes the symbols that were entered after the scope was
+    opened at sym_idx = mark.
+*/
+void closescope(int mark)
+{
+    symbol_t *sym;
+
+    while (sym_idx > mark) {
+	sym = symbols[--sym_idx];
+	symtab[sym->hash & (symtab_max - 1)] = sym->next;
+    }
 }
 
 /*
-    getch reads a single character. Stops at end of file.
+    lookup locates a symbol in the symbol table, and returns 0 when the symbol
+    is not found. The innermost declaration hides the others.
 */
-int getch()
+symbol_t *lookup(char *str)
 {
-    int ch;
+    unsigned hash;
+    symbol_t *sym;
 
-    if ((ch = getchar()) == EOF)
-	exit(0);
-    if (ch == '\n')
-	linenum++;
-    return ch;
+    if (!symtab_max)
+	return 0;
+    hash = hashname(str);
+    for (sym = symtab[hash & (symtab_max - 1)]; sym; sym = sym->next)
+	if (sym->hash == hash && !strcmp(str, sym->name))
+	    return sym;
+    return 0;
 }
 
 /*
-    ungetch unreads a character. Whitespace need not be unread.
+    readsource reads the whole file in blocks into the source buffer.
 */
-void ungetch(int ch)
+void readsource(FILE *fp)
 {
-    if (!isspace(ch))
-	ungetc(ch, stdin);
+    size_t size = 0, max = MAXSRC, n;
+
+    source = malloc(max + 1);
+    while ((n = fread(source + size, 1, max - size, fp)) > 0)
+	if ((size += n) == max)
+	    source = realloc(source, (max *= 2) + 1);
+    source[size] = 0;
+    cursor = source;
 }
 
 /*
     getsym reads a symbol, stores the text of the symbol in the global variable
     val_variable if it is a variable or val_number if it is a number and
-    returns the type.
+    returns the type. linenum is the line of the symbol. At the end of the file
+    the symbol is typ_eof, which no rule accepts.
 */
 void getsym()
 {
-    int ch, i = 0;
-    char str[MAXVAR + 1];
+    int i;
+    char *ptr = cursor, *start;
 
-    do
-	ch = getch();
-    while (isspace(ch));
-    if (ch == '-') {			/* deal with hyphen first, complex */
-	ch = getch();
-	if (isspace(ch)) {
-	    symbol = '-';
-	    return;
-	}
-	if (isalpha(ch)) {
-	    str[i++] = '-';
+    for (; isspace((unsigned char)*ptr); ptr++)
+	if (*ptr == '\n')
+	    linenum++;
+    if (!*ptr) {
+	if (symbol != typ_eof)
+	    error("unexpected end of file");
+	symbol = typ_eof;
+	cursor = ptr;
+	return;
+    }
+    start = ptr++;
+    switch (*start) {
+    case '-':				/* hyphen can start a name or number */
+	if (isalpha((unsigned char)*ptr))
 	    goto alpha;
-	}
-	if (isdigit(ch)) {
-	    str[i++] = '-';
+	if (isdigit((unsigned char)*ptr))
 	    goto digit;
-	}
-	ungetch(ch);			/*  1 character too many, read again */
 	symbol = '-';
-	return;
-    }
-    if (ch == '<') {			/* deal with unequal next */
-	ch = getch();
-	if (ch == '>') {
+	break;
+    case '<':
+	if (*ptr == '>') {
+	    ptr++;
 	    symbol = typ_unequal;
-	    return;
-	}
-	if (ch == '=') {
+	} else if (*ptr == '=') {
+	    ptr++;
 	    symbol = typ_lesseql;
-	    return;
-	}
-	ungetch(ch);
-	symbol = '<';
-	return;
-    }
-    if (ch == '>') {
-	ch = getch();
-	if (ch == '=') {
+	} else
+	    symbol = '<';
+	break;
+    case '>':
+	if (*ptr == '=') {
+	    ptr++;
 	    symbol = typ_moreeql;
-	    return;
-	}
-	ungetch(ch);
-	symbol = '>';
-	return;
-    }
-    if (ch == ':') {
-	ch = getch();
-	if (ch == '=') {
+	} else
+	    symbol = '>';
+	break;
+    case ':':
+	if (*ptr == '=') {
+	    ptr++;
 	    symbol = typ_assign;
-	    return;
-	}
-	ungetch(ch);			/* not assignment, single colon */
-	symbol = ':';			/* unexpected character */
-	return;
-    }
-    if (strchr("()*+/.;=", ch)) {	/* rest of single characters */
-	symbol = ch;
-	return;
+	} else
+	    symbol = ':';		/* unexpected character */
+	break;
+    default:
+	if (isalpha((unsigned char)*start))
+	    goto alpha;
+	if (isdigit((unsigned char)*start))
+	    goto digit;
+	symbol = *start;		/* single or unexpected character */
+	break;
     }
-    if (isalpha(ch))
-	goto alpha;
-    if (isdigit(ch))
-	goto digit;
-    symbol = ch;			/* unexpected character */
+    cursor = ptr;
     return;
 alpha:
-    do {
-	if (i < MAXVAR)
-	    str[i++] = ch;
-	ch = getch();
-    } while (isalnum(ch) || ch == '-');
-    str[i] = 0;
-    ungetch(ch);			/* undo last  */
-    for (i = 0; i <= MAXKEY; i++)
-	if (!strcmp(str, keywords[i])) {
-	    symbol = i;			/* keyword */
-	    return;
-	}
-    strcpy(val_variable, str);
+    while (isalnum((unsigned char)*ptr) || *ptr == '-')
+	ptr++;
+    cursor = ptr;
+    i = ptr - start;
+    if (i > 1 && i <= MAXVAR && (symbol = keyhash[KEYHASH(start, i)]) >= 0 &&
+	!strncmp(start, keywords[symbol], i) && !keywords[symbol][i])
+	return;				/* keyword */
+    if (i > MAXVAR)
+	i = MAXVAR;
+    memcpy(val_variable, start, i);
+    val_variable[i] = 0;
     symbol = typ_variable;		/* variable */
     return;
 digit:
-    do {
-	if (i < MAXVAR)
-	    str[i++] = ch;
-	ch = getch();
-    } while (isdigit(ch));
-    str[i] = 0;
-    ungetch(ch);			/* undo last  */
-    val_number = atoi(str);
+    while (isdigit((unsigned char)*ptr))
+	ptr++;
+    cursor = ptr;
+    errno = 0;
+    val_number = strtoll(start, 0, 10);
     symbol = typ_number;		/* number */
+    if (errno == ERANGE)
+	error("number out of range");
+}
+
+/*
+    remember saves the position of the scanner in scan; recall goes back to it.
+*/
+void remember(scan_t *scan)
+{
+    scan->cursor = cursor;
+    strcpy(scan->variable, val_variable);
+    scan->linenum = linenum;
+    scan->symbol = symbol;
+    scan->number = val_number;
+}
+
+void recall(scan_t *scan)
+{
+    cursor = scan->cursor;
+    strcpy(val_variable, scan->variable);
+    linenum = scan->linenum;
+    symbol = scan->symbol;
+    val_number = scan->number;
 }
 
-void expr2(int *);	/* forward */
+void expr2(int *, int *);	/* forward */
 
 /*
 factor ::= variable | number | "FALSE" | "TRUE" | "NOT" factor | "(" expr2 ")"
 */
 void factor(int *type)
 {
-    int index, found;
+    int jumps[2] = { 0, 0 };
+    symbol_t *sym;
 
+    if (regnum > MAXREG)
+	error("expression needs too many registers");
     switch (symbol) {
     case typ_variable:
-	index = lookup(val_variable, &found, type);
-	if (found == -1)
+	if ((sym = lookup(val_variable)) == 0)
 	    error("variable not found");	/* undeclared variable */
-	else if (found == 1)
-	    enterprog(loadlocal, regnum, index);
-	else if (found == 0)
-	    enterprog(loadglobl, regnum, index);
+	else {
+	    *type = sym->type;
+	    if (sym->kind == 1)
+		enterprog(loadlocal, regnum, sym->adr);
+	    else if (sym->kind == 0)
+		enterprog(loadglobl, regnum, sym->adr);
+	}
 	getsym();
 	break;
     case typ_number:
@@ -378,17 +629,17 @@ void factor(int *type)
 	factor(type);
 	if (*type != 0)
 	    error("boolean type expected for operator not");
-	if (code[code_idx].op == loadimmed)
-	    code[code_idx].adr2 = -code[code_idx].adr2;
-	else
-	    enterprog(neg, regnum, 0);
+	enterprog(neg, regnum, 0);
 	break;
     case '(':
 	getsym();
-	expr2(type);
+	expr2(type, jumps);
 	if (symbol != ')')
 	    error("')' expected at end of parenthesized expression");
 	getsym();
+	pending[0] = jumps[0];	/* taken by term2, or materialized */
+	pending[1] = jumps[1];
+	pendreg = regnum;
 	break;
     default:
 	error("illegal start of factor");
@@ -410,28 +661,12 @@ void term1(int *type)
 	factor(&type2);
 	if (*type != 1 || type2 != 1)
 	    error("integer type expected for *,/,MOD");
-	if (oper == '*') {
-	    if (code[code_idx].op == loadimmed &&
-		code[code_idx - 1].op == loadimmed) {
-		code[code_idx - 1].adr2 *= code[code_idx].adr2;
-		code_idx--;
-	    } else
-		enterprog(mul, regnum - 1, regnum);
-	} else if (oper == '/') {
-	    if (code[code_idx].op == loadimmed &&
-		code[code_idx - 1].op == loadimmed) {
-		code[code_idx - 1].adr2 /= code[code_idx].adr2;
-		code_idx--;
-	    } else
-		enterprog(dvd, regnum - 1, regnum);
-	} else if (oper == typ_mod) {
-	    if (code[code_idx].op == loadimmed &&
-		code[code_idx - 1].op == loadimmed) {
-		code[code_idx - 1].adr2 %= code[code_idx].adr2;
-		code_idx--;
-	    } else
-		enterprog(mdl, regnum - 1, regnum);
-	}
+	if (oper == '*')
+	    enterprog(mul, regnum - 1, regnum);
+	else if (oper == '/')
+	    enterprog(dvd, regnum - 1, regnum);
+	else if (oper == typ_mod)
+	    enterprog(mdl, regnum - 1, regnum);
 	regnum--; /* discard register from second factor */
     }
 }
@@ -451,21 +686,10 @@ void expr1(int *type)
 	term1(&type2);
 	if (*type != 1 || type2 != 1)
 	    error("integer type expected for +,-");
-	if (oper == '+') {
-	    if (code[code_idx].op == loadimmed &&
-		code[code_idx - 1].op == loadimmed) {
-		code[code_idx - 1].adr2 += code[code_idx].adr2;
-		code_idx--;
-	    } else
-		enterprog(add, regnum - 1, regnum);
-	} else if (oper == '-') {
-	    if (code[code_idx].op == loadimmed &&
-		code[code_idx - 1].op == loadimmed) {
-		code[code_idx - 1].adr2 -= code[code_idx].adr2;
-		code_idx--;
-	    } else
-		enterprog(sub, regnum - 1, regnum);
-	}
+	if (oper == '+')
+	    enterprog(add, regnum - 1, regnum);
+	else if (oper == '-')
+	    enterprog(sub, regnum - 1, regnum);
 	regnum--; /* discard register from second factor */
     }
 }
@@ -488,122 +712,196 @@ void compar(int *type)
 	if (*type != type2)
 	    error("same type expected in comparison");
 	*type = 0;
-	if (oper == '<') {
-	    if (code[code_idx].op == loadimmed &&
-		code[code_idx - 1].op == loadimmed) {
-		code[code_idx - 1].adr2 = code[code_idx - 1].adr2 <
-					  code[code_idx].adr2;
-		code_idx--;
-	    } else
-		enterprog(lss, regnum - 1, regnum);
-	} else if (oper == '=') {
-	    if (code[code_idx].op == loadimmed &&
-		code[code_idx - 1].op == loadimmed) {
-		code[code_idx - 1].adr2 = code[code_idx - 1].adr2 ==
-					  code[code_idx].adr2;
-		code_idx--;
-	    } else
-		enterprog(eql, regnum - 1, regnum);
-	} else if (oper == '>') {
-	    if (code[code_idx].op == loadimmed &&
-		code[code_idx - 1].op == loadimmed) {
-		code[code_idx - 1].adr2 = code[code_idx - 1].adr2 >
-					  code[code_idx].adr2;
-		code_idx--;
-	    } else
-		enterprog(gtr, regnum - 1, regnum);
-	} else if (oper == typ_unequal) {
-	    if (code[code_idx].op == loadimmed &&
-		code[code_idx - 1].op == loadimmed) {
-		code[code_idx - 1].adr2 = code[code_idx - 1].adr2 !=
-					  code[code_idx].adr2;
-		code_idx--;
-	    } else
-		enterprog(neq, regnum - 1, regnum);
-	} else if (oper == typ_lesseql) {
-	    if (code[code_idx].op == loadimmed &&
-		code[code_idx - 1].op == loadimmed) {
-		code[code_idx - 1].adr2 = code[code_idx - 1].adr2 <=
-					  code[code_idx].adr2;
-		code_idx--;
-	    } else
-		enterprog(leq, regnum - 1, regnum);
-	} else if (oper == typ_moreeql) {
-	    if (code[code_idx].op == loadimmed &&
-		code[code_idx - 1].op == loadimmed) {
-		code[code_idx - 1].adr2 = code[code_idx - 1].adr2 >=
-					  code[code_idx].adr2;
-		code_idx--;
-	    } else
-		enterprog(geq, regnum - 1, regnum);
-	}
+	if (oper == '<')
+	    enterprog(lss, regnum - 1, regnum);
+	else if (oper == '=')
+	    enterprog(eql, regnum - 1, regnum);
+	else if (oper == '>')
+	    enterprog(gtr, regnum - 1, regnum);
+	else if (oper == typ_unequal)
+	    enterprog(neq, regnum - 1, regnum);
+	else if (oper == typ_lesseql)
+	    enterprog(leq, regnum - 1, regnum);
+	else if (oper == typ_moreeql)
+	    enterprog(geq, regnum - 1, regnum);
 	regnum--; /* discard register from second factor */
     }
 }
 
+/*
+    A condition is compiled to jumps, that skip the rest of it as soon as its
+    value is known. The jumps that are taken when it is false, and those that
+    are taken when it is true, are kept in two chains, linked through adr1;
+    the code that falls through leaves the value of the last operand in
+    register regnum. A jump taken when false is a jiz on that register, so
+    that it is 0 at the target.
+*/
+
+/*
+    patch makes the jumps in chain go to instruction to.
+*/
+void patch(int chain, int to)
+{
+    int next;
+
+    if (chain)
+	patched = to;
+    for (; chain; chain = next) {
+	next = code[chain].adr1;
+	code[chain].adr1 = to;
+    }
+}
+
+/*
+    join returns the chain of the jumps in chain and in more.
+*/
+int join(int chain, int more)
+{
+    int last;
+
+    if (!more)
+	return chain;
+    for (last = more; code[last].adr1; last = code[last].adr1)
+	;
+    code[last].adr1 = chain;
+    return more;
+}
+
+/*
+    take adds the jumps of a parenthesized condition that was just compiled.
+*/
+void take(int *jumps)
+{
+    jumps[0] = join(jumps[0], pending[0]);
+    jumps[1] = join(jumps[1], pending[1]);
+    pending[0] = pending[1] = 0;
+}
+
+/*
+    jumpfalse adds a jump to jumps[0], that is taken when the condition is
+    false; the jumps taken when true continue after it.
+*/
+void jumpfalse(int *jumps)
+{
+    enterprog(jiz, jumps[0], regnum);
+    jumps[0] = code_idx;
+    patch(jumps[1], code_idx + 1);
+    jumps[1] = 0;
+}
+
+/*
+    jumptrue adds a jump to jumps[1], that is taken when the condition is
+    true; the jumps taken when false continue after it. A comparison that
+    computed regnum is reversed, unless a jump goes to the instruction after
+    it; otherwise regnum is negated.
+*/
+void jumptrue(int *jumps)
+{
+    static operator reverse[] = { neq, eql, leq, lss, geq, gtr };
+    code_t *p = &code[code_idx];
+
+    if (p->op >= eql && p->op <= leq && p->adr1 == regnum &&
+	patched != code_idx + 1)
+	p->op = reverse[p->op - eql];
+    else
+	enterprog(neg, regnum, 0);
+    enterprog(jiz, jumps[1], regnum);
+    jumps[1] = code_idx;
+    patch(jumps[0], code_idx + 1);
+    jumps[0] = 0;
+}
+
+/*
+    materialize puts the value of the condition in register reg. The jumps
+    taken when false already leave 0 there; the jumps taken when true load 1.
+*/
+void materialize(int *jumps, int reg)
+{
+    int skip;
+
+    if (jumps[1]) {
+	enterprog(jmp, 0, 0);
+	skip = code_idx;
+	patch(jumps[1], code_idx + 1);
+	enterprog(loadimmed, reg, 1);
+	code[skip].adr1 = code_idx + 1;
+    }
+    patch(jumps[0], code_idx + 1);
+    jumps[0] = jumps[1] = 0;
+}
+
 /*
 term2  ::= compar [ "AND" compar ]
 */
-void term2(int *type)
+void term2(int *type, int *jumps)
 {
     int type2;
 
     compar(type); /* store first factor in current register */
+    take(jumps);
     while (symbol == typ_and) {
 	getsym();
-	regnum++; /* store second factor in next register */
+	jumpfalse(jumps); /* skip the rest when false */
 	compar(&type2);
+	take(jumps);
 	if (*type != 0 || type2 != 0)
 	    error("boolean types expected for operator and");
-	if (code[code_idx].op == loadimmed &&
-	    code[code_idx - 1].op == loadimmed) {
-	    code[code_idx - 1].adr2 &= code[code_idx].adr2;
-	    code_idx--;
-	} else
-	    enterprog(mul, regnum - 1, regnum); /* no 'and' avail */
-	regnum--; /* discard register from second factor */
     }
 }
 
 /*
 sexpr  ::= term2 [ "OR" term2 ]
 */
-void sexpr(int *type)
+void sexpr(int *type, int *jumps)
 {
-    int type2;
+    int type2, more[2];
 
-    term2(type); /* store first factor in current register */
+    term2(type, jumps); /* store first factor in current register */
     while (symbol == typ_or) {
 	getsym();
-	regnum++; /* store second factor in next register */
-	term2(&type2);
+	jumptrue(jumps); /* skip the rest when true */
+	more[0] = more[1] = 0;
+	term2(&type2, more);
+	jumps[0] = more[0];
+	jumps[1] = join(jumps[1], more[1]);
 	if (*type != 0 || type2 != 0)
 	    error("boolean types expected for operator or");
-	if (code[code_idx].op == loadimmed &&
-	    code[code_idx - 1].op == loadimmed) {
-	    code[code_idx - 1].adr2 |= code[code_idx].adr2;
-	    code_idx--;
-	} else
-	    enterprog(orr, regnum - 1, regnum);
-	regnum--; /* discard register from second factor */
     }
 }
 
 /*
 expr2  ::= sexpr [ "IFF" sexpr ]
 */
-void expr2(int *type)
+void expr2(int *type, int *jumps)
 {
-    sexpr(type); /* store first factor in current register */
+    int type2, more[2];
+
+    sexpr(type, jumps); /* store first factor in current register */
     while (symbol == typ_iff) {
 	getsym();
+	materialize(jumps, regnum);
 	regnum++; /* store second factor in next register */
-	sexpr(type);
+	more[0] = more[1] = 0;
+	sexpr(&type2, more);
+	materialize(more, regnum);
+	if (*type != 0 || type2 != 0)
+	    error("boolean types expected for operator iff");
+	enterprog(eql, regnum - 1, regnum);
 	regnum--; /* discard register from second factor */
-	/* not sure what code to generate */
     }
 }
 
+/*
+    value computes expr2 in register regnum.
+*/
+void value(int *type)
+{
+    int jumps[2] = { 0, 0 };
+
+    expr2(type, jumps);
+    materialize(jumps, regnum);
+}
+
 void statementseq(int *);	/* forward */
 
 /*
@@ -612,68 +910,83 @@ statement ::=	variable ":=" expr2 |
 		"WRITE" expr2 |
 		"IF" expr2 "THEN" statementseq "ENDIF" |
 		"WHILE" expr2 "DO" statementseq "ENDWHILE"
+
+    A WHILE loop tests its condition at the end, where it jumps back when
+    true; the condition is also compiled before the loop, to skip it when
+    false. The condition is read twice from the source for that.
 */
 void statement(int *type)
 {
-    int index, found, type2, target[2];
+    int type2, top, mark, jumps[2] = { 0, 0 }, again[2] = { 0, 0 },
+	line = codeline = linenum;
+    scan_t cond, end;
+    symbol_t *sym;
 
     if (symbol == typ_variable) {
-	index = lookup(val_variable, &found, type);
-	if (found == -1)
+	if ((sym = lookup(val_variable)) == 0)
 	    error("variable/function not found");
+	else
+	    *type = sym->type;
 	getsym();
 	if (symbol == typ_assign) {
 	    getsym();
-	    expr2(&type2);
-	    if (*type != type2)
+	    value(&type2);
+	    if (sym && *type != type2)
 		error("same type expected in assignment");
-	    if (found == 1)
-		enterprog(storlocal, index, regnum);
-	    else if (found == 0)
-		enterprog(storglobl, index, regnum);
-	} else {
-	    if (found != 2)
-		error("procedure name expected");
-	    enterprog(cal, *type, functions[index].parm);
-	}
+	    if (sym && sym->kind == 1)
+		enterprog(storlocal, sym->adr, regnum);
+	    else if (sym && sym->kind == 0)
+		enterprog(storglobl, sym->adr, regnum);
+	} else if (!sym || sym->kind != 2)
+	    error("procedure name expected");
+	else
+	    enterprog(cal, *type, sym->parm);
     } else if (symbol == typ_write) {
 	getsym();
-	expr2(type);
+	value(type);
 	if (*type == 0)
 	    enterprog(writebool, 0, regnum);
 	else if (*type == 1)
 	    enterprog(writeint, 0, regnum);
     } else if (symbol == typ_if) {
 	getsym();
-	expr2(type);
+	expr2(type, jumps);
 	if (*type != 0)
 	    error("boolean condition expected in if");
 	if (symbol != typ_then)
 	    error("THEN expected after if-condition");
-	enterprog(jiz, 0, regnum);
-	target[0] = code_idx;			/* to be fixed */
+	jumpfalse(jumps);			/* to be fixed */
 	getsym();
 	statementseq(type);
 	if (symbol != typ_endif)
 	    error("ENDIF expected at end of if statement");
-	code[target[0]].adr1 = code_idx + 1;	/* fixing */
+	patch(jumps[0], code_idx + 1);		/* fixing */
 	getsym();
     } else if (symbol == typ_while) {
 	getsym();
-	target[0] = code_idx + 1;		/* target of jump */
-	expr2(type);
+	remember(&cond);
+	mark = errors;
+	expr2(type, jumps);
 	if (*type != 0)
 	    error("boolean condition expected in while");
 	if (symbol != typ_do)
 	    error("DO expected after while-condition");
-	enterprog(jiz, 0, regnum);
-	target[1] = code_idx;			/* to be fixed */
+	jumpfalse(jumps);			/* to be fixed */
+	top = code_idx + 1;			/* target of jump */
 	getsym();
 	statementseq(type);
 	if (symbol != typ_endwhile)
 	    error("ENDWHILE expected at end of while statement");
-	enterprog(jmp, target[0], 0);
-	code[target[1]].adr1 = code_idx + 1;	/* fixing */
+	if (errors == mark) {
+	    remember(&end);
+	    recall(&cond);
+	    codeline = line;
+	    expr2(type, again);
+	    jumptrue(again);
+	    patch(again[1], top);
+	    recall(&end);
+	}
+	patch(jumps[0], code_idx + 1);		/* fixing */
 	getsym();
     }
 }
@@ -714,7 +1027,8 @@ program ::= [ ( "BOOLEAN" | "INTEGER" ) [ identifier ] |
 */
 void program()
 {
-    int type, index, found, type2, target;
+    int type, mark;
+    symbol_t *proc;
 
     getsym();
     while (symbol == typ_boolean || symbol == typ_integer ||
@@ -724,66 +1038,2344 @@ void program()
 	    do {
 		getsym();
 		if (symbol == typ_variable) {
-		    lookup(val_variable, &found, &type2);
-		    if (found == -1)
-			enterglobal(type);
-		    else
+		    if (lookup(val_variable))
 			error("global variable already exists");
+		    else
+			enter(0, global_idx++, type);
 		}
 	    } while (symbol == typ_variable);
 	} else {
 	    getsym();	/* name of procedure */
-	    lookup(val_variable, &found, &type2);
-	    if (found == -1)
-		enterfunction(code_idx + 1);
-	    else
+	    if ((proc = lookup(val_variable)) != 0)
 		error("procedure name already exists");
-	    target = function_idx - 1;
+	    else
+		proc = enter(2, 0, code_idx + 1);
+	    enterprocname(proc->name);
 	    getsym();
-	    index = local_idx;
+	    mark = sym_idx;
+	    /*
+		The frame of a procedure starts with the return link, in
+		local variables 1 and 2; its own variables follow.
+	    */
+	    local_idx = 0;
 	    while (symbol == typ_boolean || symbol == typ_integer) {
 		type = symbol == typ_integer;
 		do {
 		    getsym();
 		    if (symbol == typ_variable) {
-			lookup(val_variable, &found, &type2);
-			if (found == -1)
-			    enterlocal(type);
-			else
+			if (lookup(val_variable))
 			    error("local variable already exists");
+			else
+			    enter(1, 3 + local_idx++, type);
 		    }
 		} while (symbol == typ_variable);
 	    }
-	    functions[target].parm = 2 + local_idx - index;
+	    proc->parm = 2 + local_idx;
 	    body(&type);
-	    local_idx = index;
+	    closescope(mark);
+	    codeline = linenum;
 	    enterprog(ret, 0, 0);
 	}
     }
+    enterprocname("(main)");
     code[1].op = cal;
     code[1].adr1 = code_idx + 1;
     code[1].adr2 = global_idx;
+    code[1].line = codeline = linenum;
+    code[1].proc = procname_idx - 1;
     body(&type);
     if (symbol != '.')
 	error("full stop expected at end of program");
+    codeline = linenum;
     enterprog(hlt, 0, 0);
 }
 
 /*
-    This program writes to stdout that is then transformed to a binary file
-    by the dump program.
+    isjump tells whether adr1 of an instruction is an index in the code array.
 */
-int main(int argc, char *argv[])
+int isjump(operator op)
 {
-    int i;
+    return op == jmp || op == jiz || op == cal || (op >= jeql && op <= jleq);
+}
 
-    if (argc == 2 && !freopen(argv[1], "r", stdin)) {
-	fprintf(stderr, "failed to open the file '%s'.\n", argv[1]);
-	exit(EXIT_FAILURE);
-    }
-    program();
-    for (i = 1; i <= code_idx; i++)
-	printf("%8d%15s%12" PRId64 "%12" PRId64 "\n",
-		i, operator_NAMES[code[i].op], code[i].adr1, code[i].adr2);
+/*
+    ends tells whether an instruction ends a basic block.
+*/
+int ends(operator op)
+{
+    return isjump(op) || op == ret || op == hlt;
+}
+
+/*
+    inreg1 tells whether adr1 of an instruction is a register that is written;
+    inreg2 tells whether adr2 is a register that is read.
+*/
+int inreg1(operator op)
+{
+    return op <= loadimmed || (op >= addimmed && op <= addlocal) ||
+	   op == loadconst || op == mov;
+}
+
+int inreg2(operator op)
+{
+    return op <= orr || (op >= storglobl && op <= writeint) || op == jiz ||
+	   op == mov;
+}
+
+/*
+    uses returns the set of registers that instruction p reads; defs returns
+    the set of registers that it writes. A call may write all registers.
+*/
+int uses(code_t *p)
+{
+    int set = 0;
+
+    if (p->op >= jeql && p->op <= jleq)
+	return 1 << LEFT(p->adr2) | 1 << RIGHT(p->adr2);
+    if (inreg2(p->op))
+	set = 1 << (p->adr2 & 15);
+    if (p->op <= neg || (p->op >= addimmed && p->op <= addlocal))
+	set |= 1 << (p->adr1 & 15);
+    return set;
+}
+
+int defs(code_t *p)
+{
+    if (p->op == cal)
+	return -1;
+    return inreg1(p->op) ? 1 << (p->adr1 & 15) : 0;
+}
+
+int reads(code_t *p, int r)
+{
+    return uses(p) >> r & 1;
+}
+
+int writes(code_t *p, int r)
+{
+    return defs(p) >> r & 1;
+}
+
+/*
+    replace renames register from to register to in the operands of p that
+    are only read, or in all operands when all is set.
+*/
+void replace(code_t *p, int from, int to, int all)
+{
+    if (p->op >= jeql && p->op <= jleq) {
+	if (LEFT(p->adr2) == from)
+	    p->adr2 = PAIR(to, RIGHT(p->adr2));
+	if (RIGHT(p->adr2) == from)
+	    p->adr2 = PAIR(LEFT(p->adr2), to);
+    } else if (inreg2(p->op) && p->adr2 == from)
+	p->adr2 = to;
+    if (all && inreg1(p->op) && p->adr1 == from)
+	p->adr1 = to;
+}
+
+/*
+    marktargets records which instructions are the target of a jump or call.
+*/
+void marktargets()
+{
+    int i;
+
+    target = realloc(target, code_idx + 2);
+    memset(target, 0, code_idx + 2);
+    for (i = 1; i <= code_idx; i++)
+	if (isjump(code[i].op))
+	    target[code[i].adr1] = 1;
+}
+
+/*
+    needs returns the set of registers that are read from instruction i on,
+    before they are written.
+*/
+int needs(int i)
+{
+    return (live[i] & ~defs(&code[i])) | uses(&code[i]);
+}
+
+/*
+    liveness computes for each instruction the set of registers that are read
+    after it, before they are written. A register is followed along the jumps,
+    until nothing changes; at the end of a basic block the registers that hold
+    variables are also needed. After a call, return or halt none are.
+*/
+void liveness()
+{
+    int i, set, changed;
+
+    live = realloc(live, (code_idx + 2) * sizeof(int));
+    memset(live, 0, (code_idx + 2) * sizeof(int));
+    do {
+	changed = 0;
+	for (i = code_idx; i > 0; i--) {
+	    set = 0;
+	    if (code[i].op == cal || code[i].op == ret || code[i].op == hlt)
+		;
+	    else {
+		if (code[i].op != jmp && i < code_idx)
+		    set = needs(i + 1);
+		if (isjump(code[i].op))
+		    set |= needs(code[i].adr1);
+		if (isjump(code[i].op) || i == code_idx || target[i + 1])
+		    set |= homes;
+	    }
+	    if (live[i] != set) {
+		live[i] = set;
+		changed = 1;
+	    }
+	}
+    } while (changed);
+}
+
+/*
+    dead tells whether register r is not needed after instruction i.
+*/
+int dead(int i, int r)
+{
+    return !(live[i] >> r & 1);
+}
+
+/*
+    rebuild removes the nop instructions from the code array and adds the
+    instructions of count insertions, ordered by position. Jump targets are
+    renumbered; a jump to a removed instruction goes to the next instruction.
+*/
+void rebuild(insert_t *list, int count)
+{
+    int i, j, k, n, size, *map, *from, *first;
+    code_t *out;
+
+    for (size = code_idx + 2, n = 0; n < count; n++)
+	size += list[n].count;
+    out = malloc(size * sizeof(code_t));
+    from = malloc(size * sizeof(int));
+    map = malloc((code_idx + 2) * sizeof(int));
+    first = malloc((code_idx + 2) * sizeof(int));
+    for (i = j = 1, n = 0; i <= code_idx + 1; i++) {
+	for (first[i] = n; n < count && list[n].at == i; n++) {
+	    list[n].start = j;
+	    for (k = 0; k < list[n].count; k++) {
+		from[j] = 0;
+		out[j] = list[n].ins[k];
+		out[j].line = code[i <= code_idx ? i : code_idx].line;
+		out[j++].proc = code[i <= code_idx ? i : code_idx].proc;
+	    }
+	}
+	map[i] = j;
+	if (i <= code_idx && code[i].op != nop) {
+	    from[j] = i;
+	    out[j++] = code[i];
+	}
+    }
+    for (i = 1; i < j; i++)
+	if (isjump(out[i].op)) {
+	    k = out[i].adr1;
+	    out[i].adr1 = map[k];
+	    for (n = first[k]; n < count && list[n].at == k; n++)
+		if ((from[i] >= list[n].lo && from[i] <= list[n].hi) ==
+		    list[n].inside) {
+		    out[i].adr1 = list[n].start;
+		    break;
+		}
+	}
+    free(code);
+    code = out;
+    code_idx = j - 1;
+    code_max = size;
+    free(first);
+    free(map);
+    free(from);
+}
+
+/*
+    reaches tells whether procedure p calls procedure q, directly or through
+    other procedures; seen marks the procedures that were looked at.
+*/
+int reaches(proc_t *procs, int p, int q, char *seen)
+{
+    int i;
+    code_t *ins;
+
+    if (seen[p])
+	return 0;
+    seen[p] = 1;
+    for (i = 0; i < procs[p].count; i++) {
+	ins = &procs[p].body[i];
+	if (ins->op == cal &&
+	    (ins->adr1 == q || reaches(procs, ins->adr1, q, seen)))
+	    return 1;
+    }
+    return 0;
+}
+
+/*
+    worth tells whether the call of procedure q at line, in procedure p, is
+    inlined, and reports it when verbose is set. A procedure that can call
+    itself is not inlined, nor is one with local variables in a procedure
+    that can call itself, as every level of the recursion would get room
+    for them.
+*/
+int worth(proc_t *procs, int p, int q, int line)
+{
+    char *why = 0;
+
+    if (procs[q].recursive)
+	why = "recursive";
+    else if (procs[q].count - 1 > INLINE && procs[q].calls > 1)
+	why = "too large";
+    else if (procs[p].recursive && procs[q].frame > 2)
+	why = "has local variables and the caller is recursive";
+    if (verbose && why)
+	fprintf(stderr, "%d: %s not inlined in %s, %s\n", line, procnames[q],
+		procnames[p], why);
+    else if (verbose)
+	fprintf(stderr, "%d: %s inlined in %s, %d instructions\n", line,
+		procnames[q], procnames[p], procs[q].count - 1);
+    return !why;
+}
+
+/*
+    expand inlines the calls in procedure p that are worth it, after those
+    in the procedures that it calls. The body of a procedure is copied
+    without its return, so that a jump to the return goes to the instruction
+    after the call. Its local variables follow those of p, and the procedures
+    that p calls share that room. A call of p itself that is followed by the
+    return of p becomes a jump to the start of p.
+*/
+void expand(proc_t *procs, int p)
+{
+    int i, k, n, *map;
+    proc_t *self = &procs[p], *callee;
+    code_t *body, *ins;
+
+    if (self->state)
+	return;
+    self->state = 1;
+    for (i = 0; i < self->count; i++)
+	if (self->body[i].op == cal)
+	    expand(procs, self->body[i].adr1);
+    map = malloc((self->count + 1) * sizeof(int));
+    for (n = i = 0; i < self->count; i++) {
+	map[i] = n;
+	ins = &self->body[i];
+	if (ins->op == cal && worth(procs, p, ins->adr1, ins->line)) {
+	    ins->op = nop;
+	    n += procs[ins->adr1].count - 1;
+	} else
+	    n++;
+    }
+    map[i] = n;
+    body = malloc(n * sizeof(code_t));
+    for (n = i = 0; i < self->count; i++) {
+	ins = &self->body[i];
+	if (ins->op != nop) {
+	    body[n] = *ins;
+	    if (isjump(ins->op) && ins->op != cal)
+		body[n].adr1 = map[ins->adr1];
+	    n++;
+	    continue;
+	}
+	callee = &procs[ins->adr1];
+	for (k = 0; k < callee->count - 1; k++, n++) {
+	    body[n] = callee->body[k];
+	    body[n].proc = p;
+	    if (isjump(body[n].op) && body[n].op != cal)
+		body[n].adr1 += map[i];
+	    else if (body[n].op == loadlocal)
+		body[n].adr2 += self->locals - 2;
+	    else if (body[n].op == storlocal)
+		body[n].adr1 += self->locals - 2;
+	}
+	if (self->frame < self->locals + callee->frame - 2)
+	    self->frame = self->locals + callee->frame - 2;
+    }
+    for (i = 0; i < n; i++) {
+	if (body[i].op != cal || body[i].adr1 != p)
+	    continue;
+	for (k = i + 1; body[k].op == jmp && body[k].adr1 > k; k = body[k].adr1)
+	    ;
+	if (body[k].op != ret)
+	    continue;
+	if (verbose)
+	    fprintf(stderr, "%d: tail call of %s becomes a jump\n",
+		    body[i].line, procnames[p]);
+	body[i].op = jmp;
+	body[i].adr1 = body[i].adr2 = 0;
+    }
+    free(self->body);
+    self->body = body;
+    self->count = n;
+    self->state = 2;
+    free(map);
+}
+
+/*
+    inlining substitutes procedures at their calls, see expand. Then the
+    code array is laid out again, with the procedures in their order,
+    leaving out those that are no longer called. A call gets the frame of
+    the procedure after inlining.
+*/
+void inlining()
+{
+    int i, j, p, q, top = procname_idx - 1, *entry;
+    proc_t *procs;
+    code_t *out, *ins;
+    char *seen;
+
+    procs = calloc(procname_idx, sizeof(proc_t));
+    entry = malloc(procname_idx * sizeof(int));
+    seen = malloc(procname_idx);
+    for (i = 2; i <= code_idx; i = j) {
+	p = code[i].proc;
+	for (j = i; j <= code_idx && code[j].proc == p; j++)
+	    ;
+	entry[p] = i;
+	procs[p].count = j - i;
+	procs[p].body = malloc((j - i) * sizeof(code_t));
+	memcpy(procs[p].body, &code[i], (j - i) * sizeof(code_t));
+    }
+    procs[top].locals = procs[top].frame = code[1].adr2;
+    for (p = 0; p < procname_idx; p++)
+	for (i = 0; i < procs[p].count; i++) {
+	    ins = &procs[p].body[i];
+	    if (ins->op == cal) {
+		q = ins->adr1 = code[ins->adr1].proc;
+		procs[q].locals = procs[q].frame = ins->adr2;
+		procs[q].calls++;
+	    } else if (isjump(ins->op))
+		ins->adr1 -= entry[p];
+	}
+    for (p = 0; p < procname_idx; p++) {
+	memset(seen, 0, procname_idx);
+	procs[p].recursive = reaches(procs, p, p, seen);
+    }
+    expand(procs, top);
+    memset(seen, 0, procname_idx);
+    for (j = 2, p = 0; p < procname_idx; p++) {
+	entry[p] = j;
+	if (p == top || reaches(procs, top, p, seen))
+	    j += procs[p].count;
+	else
+	    procs[p].count = 0;
+	memset(seen, 0, procname_idx);
+    }
+    out = malloc((j + 1) * sizeof(code_t));
+    out[1] = code[1];
+    out[1].adr1 = entry[top];
+    out[1].adr2 = procs[top].frame;
+    for (p = 0; p < procname_idx; p++) {
+	for (i = 0; i < procs[p].count; i++) {
+	    ins = &out[entry[p] + i];
+	    *ins = procs[p].body[i];
+	    if (ins->op == cal) {
+		ins->adr2 = procs[ins->adr1].frame;
+		ins->adr1 = entry[ins->adr1];
+	    } else if (isjump(ins->op))
+		ins->adr1 += entry[p];
+	}
+	free(procs[p].body);
+    }
+    free(code);
+    code = out;
+    code_idx = j - 1;
+    code_max = j + 1;
+    free(seen);
+    free(entry);
+    free(procs);
+}
+
+/*
+    buildcfg divides the code array into basic blocks. A block ends with a
+    jump, call, return or halt, or before the target of a jump or call. The
+    successor of a call is the block that it returns to; the block that it
+    calls is an entry.
+*/
+void buildcfg()
+{
+    int i, b, next;
+    code_t *p;
+
+    marktargets();
+    blocks = realloc(blocks, (code_idx + 1) * sizeof(block_t));
+    blockof = realloc(blockof, (code_idx + 2) * sizeof(int));
+    for (nblocks = 0, i = 1; i <= code_idx; i++) {
+	if (i == 1 || target[i] || ends(code[i - 1].op)) {
+	    blocks[nblocks].first = i;
+	    blocks[nblocks++].entry = 0;
+	}
+	blocks[nblocks - 1].last = i;
+	blockof[i] = nblocks - 1;
+    }
+    for (b = 0; b < nblocks; b++) {
+	p = &code[blocks[b].last];
+	next = b + 1 < nblocks ? b + 1 : -1;
+	blocks[b].succ[0] = blocks[b].succ[1] = -1;
+	if (p->op == jmp)
+	    blocks[b].succ[0] = blockof[p->adr1];
+	else if (isjump(p->op)) {
+	    blocks[b].succ[0] = next;
+	    if (p->op == cal)
+		blocks[blockof[p->adr1]].entry = 1;
+	    else
+		blocks[b].succ[1] = blockof[p->adr1];
+	} else if (p->op != ret && p->op != hlt)
+	    blocks[b].succ[0] = next;
+    }
+}
+
+/*
+    known returns the fact about key in state s, or 0.
+*/
+fact_t *known(state_t *s, int64_t key)
+{
+    int lo = 0, hi = s->count - 1, mid;
+
+    while (lo <= hi) {
+	mid = (lo + hi) / 2;
+	if (s->fact[mid].key == key)
+	    return &s->fact[mid];
+	if (s->fact[mid].key < key)
+	    lo = mid + 1;
+	else
+	    hi = mid - 1;
+    }
+    return 0;
+}
+
+/*
+    learn records that key has value val; forget removes what is known about
+    key.
+*/
+void learn(state_t *s, int64_t key, int64_t val)
+{
+    int i;
+    fact_t *p;
+
+    if ((p = known(s, key)) != 0) {
+	p->val = val;
+	return;
+    }
+    s->fact = realloc(s->fact, (s->count + 1) * sizeof(fact_t));
+    for (i = s->count++; i > 0 && s->fact[i - 1].key > key; i--)
+	s->fact[i] = s->fact[i - 1];
+    s->fact[i].key = key;
+    s->fact[i].val = val;
+}
+
+void forget(state_t *s, int64_t key)
+{
+    fact_t *p;
+
+    if ((p = known(s, key)) != 0) {
+	memmove(p, p + 1, (&s->fact[--s->count] - p) * sizeof(fact_t));
+    }
+}
+
+/*
+    meet keeps the facts of s that t agrees with, and tells whether s changed.
+    A call keeps the facts about local variables only.
+*/
+int meet(state_t *s, state_t *t)
+{
+    int i, j, k;
+
+    for (i = j = k = 0; i < s->count; i++) {
+	while (j < t->count && t->fact[j].key < s->fact[i].key)
+	    j++;
+	if (j < t->count && t->fact[j].key == s->fact[i].key &&
+	    t->fact[j].val == s->fact[i].val)
+	    s->fact[k++] = s->fact[i];
+    }
+    i = k != s->count;
+    s->count = k;
+    return i;
+}
+
+void copystate(state_t *s, state_t *t)
+{
+    s->fact = realloc(s->fact, (t->count + 1) * sizeof(fact_t));
+    memcpy(s->fact, t->fact, t->count * sizeof(fact_t));
+    s->count = t->count;
+    s->seen = 1;
+}
+
+/*
+    compute evaluates a binary operator as 32syreci does. Division by zero and
+    overflow are left to run time.
+*/
+int compute(operator op, int64_t x, int64_t y, int64_t *val)
+{
+    switch (op) {
+    case add:
+	*val = (int64_t)((uint64_t)x + (uint64_t)y);
+	return 1;
+    case sub:
+	*val = (int64_t)((uint64_t)x - (uint64_t)y);
+	return 1;
+    case mul:
+	*val = (int64_t)((uint64_t)x * (uint64_t)y);
+	return 1;
+    case dvd:
+    case mdl:
+	if (y == 0 || (x == INT64_MIN && y == -1))
+	    return 0;
+	*val = op == dvd ? x / y : x % y;
+	return 1;
+    case eql:
+	*val = x == y;
+	return 1;
+    case neq:
+	*val = x != y;
+	return 1;
+    case gtr:
+	*val = x > y;
+	return 1;
+    case geq:
+	*val = x >= y;
+	return 1;
+    case lss:
+	*val = x < y;
+	return 1;
+    case leq:
+	*val = x <= y;
+	return 1;
+    case orr:
+	*val = x == 1 || y == 1;
+	return 1;
+    default:
+	return 0;
+    }
+}
+
+/*
+    settle records that instruction p writes the known value val, and replaces
+    it by a load of that value when fold is set.
+*/
+void settle(state_t *s, code_t *p, int fold, int64_t val)
+{
+    if (fold) {
+	p->op = loadimmed;
+	p->adr2 = val;
+    }
+    learn(s, p->adr1, val);
+}
+
+/*
+    evaluate applies instruction i to the facts in s. When fold is set, an
+    instruction with known operands is replaced by a simpler one. Variables
+    and conditions are only followed at level 2.
+*/
+void evaluate(state_t *s, int i, int fold)
+{
+    code_t *p = &code[i];
+    fact_t *x, *y;
+    int64_t key, val;
+    int r;
+
+    switch (p->op) {
+    case loadglobl:
+    case loadlocal:
+	key = VARKEY(p->op == loadlocal, p->adr2);
+	if (level > 1 && (x = known(s, key)) != 0)
+	    settle(s, p, fold, x->val);
+	else
+	    forget(s, p->adr1);
+	break;
+    case loadimmed:
+	learn(s, p->adr1, p->adr2);
+	break;
+    case storglobl:
+    case storlocal:
+	if (level < 2)
+	    break;
+	key = VARKEY(p->op == storlocal, p->adr1);
+	if ((x = known(s, p->adr2)) != 0)
+	    learn(s, key, x->val);
+	else
+	    forget(s, key);
+	break;
+    case neg:
+	if ((x = known(s, p->adr1)) != 0)
+	    settle(s, p, fold, (int64_t)(1 - (uint64_t)x->val));
+	else
+	    forget(s, p->adr1);
+	break;
+    case mov:
+	if ((x = known(s, p->adr2)) != 0)
+	    settle(s, p, fold, x->val);
+	else
+	    forget(s, p->adr1);
+	break;
+    case jiz:
+	if (level > 1 && fold && (x = known(s, p->adr2)) != 0)
+	    p->op = x->val ? nop : jmp;
+	break;
+    case cal:
+	for (r = s->count - 1; r >= 0; r--)
+	    if (s->fact[r].key < 16 || !(s->fact[r].key & 1))
+		forget(s, s->fact[r].key);
+	break;
+    default:
+	if (p->op > orr) {
+	    for (r = 0; r < 16; r++)
+		if (defs(p) >> r & 1)
+		    forget(s, r);
+	    break;
+	}
+	x = known(s, p->adr1);
+	y = known(s, p->adr2);
+	if (x && y && compute(p->op, x->val, y->val, &val))
+	    settle(s, p, fold, val);
+	else if (fold && y && ((y->val == 0 && (p->op == add ||
+		 p->op == sub)) || (y->val == 1 && (p->op == mul ||
+		 p->op == dvd))))
+	    p->op = nop;
+	else
+	    forget(s, p->adr1);
+	break;
+    }
+}
+
+/*
+    constprop replaces computations with known results by constants. At level
+    2 it follows values through variables, from block to block, until nothing
+    changes, and decides conditional jumps; at level 1 only the registers in a
+    block are followed.
+*/
+void constprop()
+{
+    int b, i, k, t, changed;
+    state_t *in, s = { 0, 0, 0 };
+
+    buildcfg();
+    in = calloc(nblocks, sizeof(state_t));
+    for (b = 0; b < nblocks; b++)
+	in[b].seen = b == 0 || blocks[b].entry || level < 2;
+    do {
+	changed = 0;
+	for (b = 0; level > 1 && b < nblocks; b++) {
+	    if (!in[b].seen)
+		continue;
+	    copystate(&s, &in[b]);
+	    for (i = blocks[b].first; i <= blocks[b].last; i++)
+		evaluate(&s, i, 0);
+	    for (k = 0; k < 2; k++) {
+		if ((t = blocks[b].succ[k]) < 0 || blocks[t].entry)
+		    continue;
+		if (!in[t].seen) {
+		    copystate(&in[t], &s);
+		    changed = 1;
+		} else if (meet(&in[t], &s))
+		    changed = 1;
+	    }
+	}
+    } while (changed);
+    for (b = 0; b < nblocks; b++) {
+	if (!in[b].seen)
+	    continue;
+	copystate(&s, &in[b]);
+	for (i = blocks[b].first; i <= blocks[b].last; i++)
+	    evaluate(&s, i, 1);
+    }
+    for (b = 0; b < nblocks; b++)
+	free(in[b].fact);
+    free(in);
+    free(s.fact);
+    rebuild(0, 0);
+}
+
+/*
+    simplify removes the blocks that cannot be reached from the start of the
+    program, and jumps to the next instruction.
+*/
+void simplify()
+{
+    int b, i, k, top = 0, *stack, *seen;
+
+    buildcfg();
+    stack = malloc((nblocks + 1) * sizeof(int));
+    seen = calloc(nblocks + 1, sizeof(int));
+    for (seen[0] = 1, stack[top++] = 0; top > 0; ) {
+	b = stack[--top];
+	for (k = 0; k < 3; k++) {
+	    if (k < 2)
+		i = blocks[b].succ[k];
+	    else if (code[blocks[b].last].op == cal)
+		i = blockof[code[blocks[b].last].adr1];
+	    else
+		continue;
+	    if (i >= 0 && !seen[i]) {
+		seen[i] = 1;
+		stack[top++] = i;
+	    }
+	}
+    }
+    for (b = 0; b < nblocks; b++)
+	if (!seen[b])
+	    for (i = blocks[b].first; i <= blocks[b].last; i++)
+		code[i].op = nop;
+    free(seen);
+    free(stack);
+    do {
+	rebuild(0, 0);
+	for (k = 0, i = 1; i < code_idx; i++)
+	    if (code[i].op == jmp && code[i].adr1 == i + 1) {
+		code[i].op = nop;
+		k = 1;
+	    }
+    } while (k);
+}
+
+/*
+    increment tells whether instruction i loads a variable that the next three
+    instructions increment; fuse turns the four of them into one instruction.
+*/
+int increment(int i)
+{
+    code_t *p = &code[i];
+
+    return i + 3 <= code_idx && (p->op == loadglobl || p->op == loadlocal) &&
+	   p[1].op == loadimmed && (p[2].op == add || p[2].op == sub) &&
+	   p[2].adr1 == p->adr1 && p[2].adr2 == p[1].adr1 &&
+	   p[3].op == p->op + storglobl - loadglobl &&
+	   p[3].adr1 == p->adr2 && p[3].adr2 == p->adr1;
+}
+
+/*
+    number returns the value number of the expression op x y in the current
+    basic block, after giving it a new number if needed.
+*/
+int number(operator op, int64_t x, int64_t y)
+{
+    unsigned h;
+    expr_t *p;
+
+    h = (unsigned)(op * 31 + x * 131 + y * 8191) & (nexprs - 1);
+    for (p = &exprs[h]; p->gen == generation; p = &exprs[h]) {
+	if (p->op == op && p->x == x && p->y == y)
+	    return p->vn;
+	h = (h + 1) & (nexprs - 1);
+    }
+    p->gen = generation;
+    p->op = op;
+    p->x = x;
+    p->y = y;
+    return p->vn = ++values;
+}
+
+/*
+    numbering gives the values computed in a basic block numbers, so that a
+    value that is still in a register need not be loaded or computed again; a
+    store of the value that a variable already has is removed.
+*/
+void numbering()
+{
+    int b, i, r, v, s, vn[16], *var, *vargen, nvars = 0;
+    int64_t key;
+    code_t *p;
+
+    for (i = 1; i <= code_idx; i++)
+	if (code[i].op >= loadglobl && code[i].op <= storlocal &&
+	    code[i].op != loadimmed) {
+	    key = VARKEY(0, code[i].op <= loadlocal ? code[i].adr2 :
+			 code[i].adr1);
+	    if (nvars < key + 2)
+		nvars = key + 2;
+	}
+    var = malloc((nvars + 1) * sizeof(int));
+    vargen = calloc(nvars + 1, sizeof(int));
+    for (nexprs = 16; nexprs < 2 * code_idx; nexprs *= 2)
+	;
+    exprs = calloc(nexprs, sizeof(expr_t));
+    buildcfg();
+    for (b = 0; b < nblocks; b++) {
+	generation++;
+	for (r = 0; r < 16; r++)
+	    vn[r] = ++values;
+	for (i = blocks[b].first; i <= blocks[b].last; i++) {
+	    p = &code[i];
+	    v = -1;
+	    switch (p->op) {
+	    case loadglobl:
+	    case loadlocal:
+		key = VARKEY(p->op == loadlocal, p->adr2);
+		if (vargen[key] != generation) {
+		    vargen[key] = generation;
+		    var[key] = ++values;
+		}
+		v = var[key];
+		break;
+	    case storglobl:
+	    case storlocal:
+		key = VARKEY(p->op == storlocal, p->adr1);
+		if (vargen[key] == generation && var[key] == vn[p->adr2])
+		    p->op = nop;
+		vargen[key] = generation;
+		var[key] = vn[p->adr2];
+		continue;
+	    case loadimmed:
+		vn[p->adr1] = number(loadimmed, p->adr2, 0);
+		continue;
+	    case mov:
+		if (vn[p->adr1] == vn[p->adr2])
+		    p->op = nop;
+		vn[p->adr1] = vn[p->adr2];
+		continue;
+	    case neg:
+		v = number(neg, vn[p->adr1], 0);
+		break;
+	    default:
+		if (p->op <= orr) {
+		    if ((p->op == add || p->op == mul || p->op == eql ||
+			 p->op == neq || p->op == orr) &&
+			vn[p->adr1] > vn[p->adr2])
+			v = number(p->op, vn[p->adr2], vn[p->adr1]);
+		    else
+			v = number(p->op, vn[p->adr1], vn[p->adr2]);
+		    break;
+		}
+		for (r = 0; r < 16; r++)
+		    if (defs(p) >> r & 1)
+			vn[r] = ++values;
+		continue;
+	    }
+	    for (s = 0; s < 16 && vn[s] != v; s++)
+		;
+	    if (s < 16 && increment(i))
+		;
+	    else if (s == p->adr1)
+		p->op = nop;
+	    else if (s < 16) {
+		p->op = mov;
+		p->adr2 = s;
+	    }
+	    vn[p->adr1] = v;
+	}
+    }
+    free(exprs);
+    free(vargen);
+    free(var);
+    rebuild(0, 0);
+}
+
+/*
+    deadcode removes the instructions that only write a register that is not
+    needed. Division is kept, because it may fail.
+*/
+void deadcode()
+{
+    int i, changed;
+
+    do {
+	changed = 0;
+	marktargets();
+	liveness();
+	for (i = code_idx; i > 0; i--)
+	    if (inreg1(code[i].op) && code[i].op != dvd &&
+		code[i].op != mdl && dead(i, code[i].adr1 & 15)) {
+		code[i].op = nop;
+		changed = 1;
+	    }
+	rebuild(0, 0);
+    } while (changed);
+}
+
+/*
+    deadstores removes stores to variables that are not loaded afterwards. A
+    call may load all global variables, a return the globals and the local
+    variables 1 and 2 that hold the return link, and after a halt nothing is
+    needed. Variable n is bit 2n of a set when global, bit 2n + 1 when local.
+    When the sets of all blocks would take too much space, a variable is
+    assumed to be needed at the end of each block.
+*/
+void deadstores()
+{
+    int b, i, k, t, n, w, words, whole, final, changed;
+    int64_t adr, max = 0, *in, *set;
+    code_t *p;
+
+    for (i = 1; i <= code_idx; i++)
+	if (code[i].op >= loadglobl && code[i].op <= storlocal &&
+	    code[i].op != loadimmed) {
+	    adr = code[i].op <= loadlocal ? code[i].adr2 : code[i].adr1;
+	    if (max < adr)
+		max = adr;
+	}
+    words = (2 * max + 2) / 64 + 1;
+    buildcfg();
+    whole = (int64_t)nblocks * words < 1 << 22;
+    in = calloc(whole ? (size_t)nblocks * words : 1, sizeof(int64_t));
+    set = malloc(words * sizeof(int64_t));
+    for (final = !whole; ; final = !changed) {
+	changed = 0;
+	for (b = nblocks - 1; b >= 0; b--) {
+	    p = &code[blocks[b].last];
+	    memset(set, whole ? 0 : -1, words * sizeof(int64_t));
+	    if (p->op == ret) {
+		for (w = 0; w < words; w++)
+		    set[w] = GLOBALS;
+		set[0] |= 1 << 3 | 1 << 5;
+	    } else if (p->op == hlt)
+		memset(set, 0, words * sizeof(int64_t));
+	    else if (whole)
+		for (k = 0; k < 2; k++)
+		    if ((t = blocks[b].succ[k]) >= 0)
+			for (w = 0; w < words; w++)
+			    set[w] |= in[(size_t)t * words + w];
+	    for (i = blocks[b].last; i >= blocks[b].first; i--) {
+		p = &code[i];
+		if (p->op == cal)
+		    for (w = 0; w < words; w++)
+			set[w] |= GLOBALS;
+		if (p->op < loadglobl || p->op > storlocal ||
+		    p->op == loadimmed)
+		    continue;
+		n = VARKEY(p->op == loadlocal || p->op == storlocal,
+			   p->op <= loadlocal ? p->adr2 : p->adr1) - 16;
+		if (p->op <= loadlocal)
+		    set[n / 64] |= (int64_t)1 << n % 64;
+		else {
+		    if (final && !(set[n / 64] >> n % 64 & 1))
+			p->op = nop;
+		    set[n / 64] &= ~((int64_t)1 << n % 64);
+		}
+	    }
+	    if (whole && memcmp(&in[(size_t)b * words], set,
+				words * sizeof(int64_t))) {
+		memcpy(&in[(size_t)b * words], set, words * sizeof(int64_t));
+		changed = 1;
+	    }
+	}
+	if (final)
+	    break;
+    }
+    free(set);
+    free(in);
+    rebuild(0, 0);
+}
+
+/*
+    insert adds an insertion before instruction at to the list. A jump from
+    inside lo .. hi goes to the inserted instructions when inside is set, and
+    a jump from outside lo .. hi when inside is not set.
+*/
+insert_t *insert(insert_t **list, int *count, int at, int lo, int hi,
+		 int inside)
+{
+    insert_t *p;
+
+    *list = realloc(*list, (*count + 1) * sizeof(insert_t));
+    p = &(*list)[(*count)++];
+    p->at = at;
+    p->lo = lo;
+    p->hi = hi;
+    p->inside = inside;
+    p->count = 0;
+    return p;
+}
+
+/*
+    spill adds the instructions that store the registers of the variables that
+    are written in the loop, or that load the registers of all variables.
+*/
+void spill(insert_t *p, var_t *vars, int nvars, int store)
+{
+    int i;
+
+    for (i = 0; i < nvars; i++) {
+	if (vars[i].reg < 0 || (store && !vars[i].dirty))
+	    continue;
+	if (store) {
+	    p->ins[p->count].op = vars[i].local ? storlocal : storglobl;
+	    p->ins[p->count].adr1 = vars[i].adr;
+	    p->ins[p->count].adr2 = vars[i].reg;
+	} else {
+	    p->ins[p->count].op = vars[i].local ? loadlocal : loadglobl;
+	    p->ins[p->count].adr1 = vars[i].reg;
+	    p->ins[p->count].adr2 = vars[i].adr;
+	}
+	p->count++;
+    }
+}
+
+/*
+    allocate keeps the variables of the loop h .. j in registers that the loop
+    does not use otherwise. The loop must be entered at h and left at j + 1.
+    The registers are loaded before the loop and stored after it; around a
+    call they are stored before and loaded after, so a variable is only kept
+    in a register when it is used more than twice as often as there are calls.
+    An increment counts as one use, as fuse makes it one instruction.
+    Loads and stores of the variables in the loop become moves. The jumps to
+    instruction i come from low[i] .. high[i].
+*/
+void allocate(int h, int j, int *low, int *high, insert_t **list,
+	      int *count)
+{
+    int i, k, r, calls = 0, nvars = 0, fused = 0, best,
+	used[MAXREG + 1] = { 0 };
+    var_t *vars = 0;
+    code_t *p;
+
+    for (i = h; i <= j; i++) {
+	p = &code[i];
+	if (p->op == ret || p->op == hlt)
+	    return;
+	if (p->op == cal) {
+	    calls++;
+	    continue;
+	}
+	if (isjump(p->op) && (p->adr1 < h || p->adr1 > j + 1))
+	    return;
+	for (r = 0; r <= MAXREG; r++)
+	    if ((uses(p) | defs(p)) >> r & 1)
+		used[r] = 1;
+	if (p->op != loadglobl && p->op != loadlocal && p->op != storglobl &&
+	    p->op != storlocal)
+	    continue;
+	k = p->op == loadlocal || p->op == storlocal;
+	for (r = 0; r < nvars; r++)
+	    if (vars[r].local == k && vars[r].adr ==
+		(p->op <= loadimmed ? p->adr2 : p->adr1))
+		break;
+	if (r == nvars) {
+	    vars = realloc(vars, ++nvars * sizeof(var_t));
+	    vars[r].local = k;
+	    vars[r].adr = p->op <= loadimmed ? p->adr2 : p->adr1;
+	    vars[r].count = vars[r].dirty = 0;
+	    vars[r].reg = -1;
+	}
+	if (i != fused)
+	    vars[r].count++;
+	if (p->op == storglobl || p->op == storlocal)
+	    vars[r].dirty = 1;
+	if (increment(i))
+	    fused = i + 3;
+    }
+    for (i = h + 1; i <= j; i++)
+	if (low[i] < h || high[i] > j)
+	    nvars = 0;
+    for (r = MAXREG, k = 0; r >= 0; r--) {
+	if (used[r])
+	    continue;
+	for (best = -1, i = 0; i < nvars; i++)
+	    if (vars[i].reg < 0 && vars[i].count > 2 * calls &&
+		(best < 0 || vars[i].count > vars[best].count))
+		best = i;
+	if (best < 0)
+	    break;
+	vars[best].reg = r;
+	homes |= 1 << r;
+	k++;
+    }
+    if (k) {
+	spill(insert(list, count, h, h, j, 0), vars, nvars, 0);
+	for (i = h; i <= j; i++) {
+	    p = &code[i];
+	    if (p->op == cal) {
+		spill(insert(list, count, i, 1, 0, 0), vars, nvars, 1);
+		spill(insert(list, count, i + 1, 1, 0, 1), vars, nvars, 0);
+		continue;
+	    }
+	    if (p->op != loadglobl && p->op != loadlocal &&
+		p->op != storglobl && p->op != storlocal)
+		continue;
+	    k = p->op == loadlocal || p->op == storlocal;
+	    for (r = 0; r < nvars; r++)
+		if (vars[r].reg >= 0 && vars[r].local == k && vars[r].adr ==
+		    (p->op <= loadimmed ? p->adr2 : p->adr1))
+		    break;
+	    if (r == nvars)
+		continue;
+	    if (p->op <= loadimmed)
+		p->adr2 = vars[r].reg;
+	    else
+		p->adr1 = vars[r].reg;
+	    p->op = mov;
+	}
+	spill(insert(list, count, j + 1, h, j, 1), vars, nvars, 1);
+    }
+    free(vars);
+}
+
+/*
+    loops calls visit for every loop, inner loops first. A loop is the code
+    from the target of a backward jump up to that jump. The loops of the same
+    height do not overlap and are done in one rebuild; liveness is computed
+    again before each height.
+*/
+void loops(void (*visit)(int, int, int *, int *, insert_t **, int *))
+{
+    int i, k, h, n, top = 0, level, maxlevel = 0, count, *height, *head,
+	*stack, *low, *high;
+    insert_t *list;
+
+    height = malloc((code_idx + 1) * sizeof(int));
+    head = malloc((code_idx + 1) * sizeof(int));
+    stack = malloc((code_idx + 1) * sizeof(int));
+    for (i = 1, n = 0; i <= code_idx; i++)
+	if (isjump(code[i].op) && code[i].op != cal && code[i].adr1 <= i) {
+	    h = code[i].adr1;
+	    for (height[n] = 0; top > 0 && head[top - 1] >= h; top--)
+		if (height[n] <= height[stack[top - 1]])
+		    height[n] = height[stack[top - 1]] + 1;
+	    if (maxlevel < height[n])
+		maxlevel = height[n];
+	    head[top] = h;
+	    stack[top++] = n++;
+	}
+    for (level = 0; n && level <= maxlevel; level++) {
+	marktargets();
+	liveness();
+	low = malloc((code_idx + 2) * sizeof(int));
+	high = calloc(code_idx + 2, sizeof(int));
+	for (i = 0; i <= code_idx + 1; i++)
+	    low[i] = code_idx + 1;
+	for (i = 1; i <= code_idx; i++)
+	    if (isjump(code[i].op) && code[i].op != cal) {
+		k = code[i].adr1;
+		if (low[k] > i)
+		    low[k] = i;
+		if (high[k] < i)
+		    high[k] = i;
+	    }
+	list = 0;
+	count = 0;
+	for (i = 1, k = 0; i <= code_idx; i++)
+	    if (isjump(code[i].op) && code[i].op != cal && code[i].adr1 <= i)
+		if (height[k++] == level)
+		    visit(code[i].adr1, i, low, high, &list, &count);
+	if (count)
+	    rebuild(list, count);
+	free(list);
+	free(high);
+	free(low);
+    }
+    free(stack);
+    free(head);
+    free(height);
+}
+
+/*
+    promote keeps variables in registers in every loop.
+*/
+void promote()
+{
+    loops(allocate);
+}
+
+/*
+    invariant moves the constants that the loop h .. j loads to before the
+    loop, where they are loaded once. The loop must be entered at h, left at
+    j + 1 and not call. A register that the loop writes only with the
+    constant, and that is not needed when the loop starts, keeps it; another
+    constant that is only read in its basic block moves to a register that
+    the loop does not use, shared by the loads of the same constant.
+*/
+void invariant(int h, int j, int *low, int *high, insert_t **list,
+	       int *count)
+{
+    int i, k, r, s, in, last, set = 0, writers[MAXREG + 1] = { 0 };
+    insert_t *p = 0;
+    code_t *q;
+
+    for (i = h; i <= j; i++) {
+	q = &code[i];
+	if (q->op == cal || q->op == ret || q->op == hlt)
+	    return;
+	if (isjump(q->op) && (q->adr1 < h || q->adr1 > j + 1))
+	    return;
+	if (i > h && (low[i] < h || high[i] > j))
+	    return;
+	set |= uses(q) | defs(q);
+	for (r = 0; r <= MAXREG; r++)
+	    writers[r] += writes(q, r);
+    }
+    in = needs(h);
+    for (i = h; i < j; i++) {
+	q = &code[i];
+	if (q->op != loadimmed)
+	    continue;
+	r = q->adr1;
+	if (writers[r] == 1 && !((in | homes) >> r & 1))
+	    s = r;
+	else if (target[i + 1])
+	    continue;
+	else {
+	    for (k = i + 1; !writes(&code[k], r); k++)
+		if (ends(code[k].op) || target[k + 1] || k == j)
+		    break;
+	    if ((reads(&code[k], r) && writes(&code[k], r)) ||
+		(!writes(&code[k], r) && !dead(k, r)))
+		continue;
+	    for (s = -1, k = 0; p && k < p->count; k++)
+		if (p->ins[k].adr2 == q->adr2)
+		    s = p->ins[k].adr1;
+	    for (k = MAXREG; s < 0 && k >= 0; k--)
+		if (!((set | in | homes) >> k & 1))
+		    s = k;
+	    if (s < 0)
+		continue;
+	    set |= 1 << s;
+	    for (k = i + 1; ; k++) {
+		last = writes(&code[k], r) || ends(code[k].op) ||
+		       target[k + 1] || k == j;
+		replace(&code[k], r, s, 0);
+		if (last)
+		    break;
+	    }
+	}
+	if (!p)
+	    p = insert(list, count, h, h, j, 0);
+	for (k = 0; k < p->count && (p->ins[k].adr1 != s ||
+				      p->ins[k].adr2 != q->adr2); k++)
+	    ;
+	if (k == p->count) {
+	    p->ins[p->count] = *q;
+	    p->ins[p->count++].adr1 = s;
+	}
+	q->op = nop;
+	writers[r]--;
+    }
+}
+
+/*
+    hoist moves the constants out of every loop.
+*/
+void hoist()
+{
+    loops(invariant);
+}
+
+/*
+    forward removes a move to register t when t is not needed afterwards, or
+    when the instruction that reads t can read the source register instead.
+    It returns the index of the last instruction that changed, or 0.
+*/
+int forward(int i)
+{
+    int k, t = code[i].adr1, r = code[i].adr2;
+
+    if (t == r || dead(i, t)) {
+	code[i].op = nop;
+	return i;
+    }
+    for (k = i + 1; k <= code_idx && !target[k]; k++) {
+	if (reads(&code[k], t))
+	    break;
+	if (writes(&code[k], r) || ends(code[k].op))
+	    return 0;
+    }
+    if (k > code_idx || target[k] || writes(&code[k], t) || !dead(k, t))
+	return 0;
+    replace(&code[k], t, r, 0);
+    code[i].op = nop;
+    return k;
+}
+
+/*
+    backward removes a move from register t to register r, when the value of t
+    is computed earlier in the same basic block and can be computed in r. The
+    old value of r may then only be read while t is still a copy of r. Reads
+    of t after the move read r instead, up to instruction end. It returns end
+    when the move was removed, or 0.
+*/
+int backward(int m)
+{
+    int d, k, end, r = code[m].adr1, t = code[m].adr2, copy;
+    code_t *p;
+
+    if (target[m])
+	return 0;
+    for (end = m; !dead(end, t); end++) {
+	if (end == code_idx || target[end + 1] || ends(code[end].op))
+	    return 0;
+	p = &code[end + 1];
+	if ((reads(p, t) && writes(p, t)) || (writes(p, r) &&
+	    !dead(end + 1, t)))
+	    return 0;
+    }
+    for (d = m - 1; d > 0; d--) {
+	if (ends(code[d].op) || writes(&code[d], r))
+	    return 0;
+	if (writes(&code[d], t) && !reads(&code[d], t))
+	    break;
+	if (target[d])
+	    return 0;
+    }
+    if (d == 0)
+	return 0;
+    copy = code[d].op == mov && code[d].adr2 == r;
+    for (k = d + 1; k < m; k++) {
+	if (reads(&code[k], r) && !copy)
+	    return 0;
+	if (writes(&code[k], t))
+	    copy = 0;
+    }
+    for (k = d; k < m; k++)
+	replace(&code[k], t, r, 1);
+    for (k = m + 1; k <= end; k++)
+	replace(&code[k], t, r, 0);
+    if (code[d].op == mov && code[d].adr1 == code[d].adr2)
+	code[d].op = nop;
+    code[m].op = nop;
+    return end;
+}
+
+/*
+    propagate removes the moves that promote introduced, by letting other
+    instructions use the registers of the variables directly. Liveness is only
+    valid after the instructions that changed, so the scan continues there.
+*/
+void propagate()
+{
+    int i, k, changed;
+
+    do {
+	changed = 0;
+	marktargets();
+	liveness();
+	for (i = 1; i <= code_idx; i++)
+	    if (code[i].op == mov && ((k = forward(i)) || (k = backward(i)))) {
+		changed = 1;
+		i = k;
+	    }
+	rebuild(0, 0);
+    } while (changed);
+}
+
+/*
+    branch returns the compare and branch instruction that jumps when the
+    comparison op fails.
+*/
+operator branch(operator op)
+{
+    switch (op) {
+    case eql:
+	return jneq;
+    case neq:
+	return jeql;
+    case gtr:
+	return jleq;
+    case geq:
+	return jlss;
+    case lss:
+	return jgeq;
+    case leq:
+	return jgtr;
+    default:
+	return hlt;
+    }
+}
+
+/*
+    match recognizes a sequence of at most n instructions starting at code[i]
+    that can be replaced by a superinstruction. It returns the length of the
+    sequence, or 0. Immediate operands must fit in adr2. The registers that the
+    superinstruction no longer writes must be dead. A negated comparison is
+    reversed, and a compare and branch over a jump becomes the opposite
+    compare and branch.
+*/
+int match(int i, int n, code_t *ins)
+{
+    static operator opposite[] = { jneq, jeql, jleq, jlss, jgeq, jgtr },
+	reverse[] = { neq, eql, leq, lss, geq, gtr };
+    code_t *p = &code[i], *q = p + 1;
+
+    if (n >= 2 && p->op >= eql && p->op <= leq && q->op == neg &&
+	q->adr1 == p->adr1) {
+	*ins = *p;
+	ins->op = reverse[p->op - eql];
+	return 2;
+    }
+
+    if (n >= 2 && p->op >= jeql && p->op <= jleq && p->adr1 == i + 2 &&
+	q->op == jmp) {
+	ins->op = opposite[p->op - jeql];
+	ins->adr1 = q->adr1;
+	ins->adr2 = p->adr2;
+	return 2;
+    }
+    if (n >= 3 && (p->op == loadglobl || p->op == loadlocal) &&
+	q->op == addimmed && q->adr1 == p->adr1 &&
+	q[1].op == (p->op == loadglobl ? storglobl : storlocal) &&
+	q[1].adr1 == p->adr2 && q[1].adr2 == p->adr1 && dead(i + 2, p->adr1)) {
+	ins->op = p->op == loadglobl ? incglobl : inclocal;
+	ins->adr1 = p->adr2;
+	ins->adr2 = q->adr2;
+	return 3;
+    }
+    if (n < 2 || !dead(i + 1, p->adr1))
+	return 0;
+    if (p->op == loadimmed && (q->op == add || q->op == sub) &&
+	q->adr2 == p->adr1 && q->adr1 != p->adr1 && SHORT(p->adr2) &&
+	SHORT(-p->adr2)) {
+	ins->op = addimmed;
+	ins->adr1 = q->adr1;
+	ins->adr2 = q->op == add ? p->adr2 : -p->adr2;
+	return 2;
+    }
+    if ((p->op == loadglobl || p->op == loadlocal) && q->op == add &&
+	q->adr2 == p->adr1 && q->adr1 != p->adr1) {
+	ins->op = p->op == loadglobl ? addglobl : addlocal;
+	ins->adr1 = q->adr1;
+	ins->adr2 = p->adr2;
+	return 2;
+    }
+    if (p->op == loadimmed && (q->op == storglobl || q->op == storlocal) &&
+	q->adr2 == p->adr1 && SHORT(p->adr2)) {
+	ins->op = q->op == storglobl ? setglobl : setlocal;
+	ins->adr1 = q->adr1;
+	ins->adr2 = p->adr2;
+	return 2;
+    }
+    if (branch(p->op) != hlt && q->op == jiz && q->adr2 == p->adr1) {
+	ins->op = branch(p->op);
+	ins->adr1 = q->adr1;
+	ins->adr2 = PAIR(p->adr1, p->adr2);
+	return 2;
+    }
+    return 0;
+}
+
+/*
+    fuse replaces common sequences of instructions by superinstructions, until
+    no more sequences are found. An instruction that is the target of a jump or
+    call must remain at the start of a sequence.
+*/
+void fuse()
+{
+    code_t ins;
+    int i, k, len, changed;
+
+    do {
+	changed = 0;
+	marktargets();
+	liveness();
+	for (i = 1; i <= code_idx; i += len) {
+	    for (len = 1; len < 3 && i + len <= code_idx; len++)
+		if (target[i + len])
+		    break;
+	    if ((len = match(i, len, &ins)) == 0)
+		len = 1;
+	    else {
+		changed = 1;
+		ins.line = code[i].line;
+		ins.proc = code[i].proc;
+		code[i] = ins;
+		for (k = 1; k < len; k++)
+		    code[i + k].op = nop;
+	    }
+	}
+	rebuild(0, 0);
+    } while (changed);
+}
+
+/*
+    stores tells whether instruction p writes the variable that load q reads.
+*/
+int stores(code_t *p, code_t *q)
+{
+    if (q->op == loadglobl)
+	return (p->op == storglobl || p->op == setglobl ||
+		p->op == incglobl) && p->adr1 == q->adr2;
+    if (q->op == loadlocal)
+	return (p->op == storlocal || p->op == setlocal ||
+		p->op == inclocal) && p->adr1 == q->adr2;
+    return 0;
+}
+
+/*
+    isload tells whether an instruction loads a register from a variable or a
+    constant; same tells whether two of them load the same value.
+*/
+int isload(operator op)
+{
+    return op == loadglobl || op == loadlocal || op == loadimmed ||
+	   op == loadconst;
+}
+
+int same(code_t *p, code_t *q)
+{
+    return p->op == q->op && p->adr2 == q->adr2;
+}
+
+/*
+    origin returns the load in first .. i - 1 that gives register r its value
+    at instruction i, or 0 when there is none or its variable is written after
+    it.
+*/
+int origin(int first, int i, int r)
+{
+    int k, j;
+
+    for (k = i - 1; k >= first && !writes(&code[k], r); k--)
+	;
+    if (k < first || !isload(code[k].op))
+	return 0;
+    for (j = k + 1; j < i; j++)
+	if (stores(&code[j], &code[k]))
+	    return 0;
+    return k;
+}
+
+/*
+    outcome returns the outcomes of a comparison for which compare and branch
+    op jumps: 1 for less, 2 for equal and 4 for greater.
+*/
+int outcome(operator op)
+{
+    static int set[] = { 2, 5, 4, 6, 1, 3 };
+
+    return set[op - jeql];
+}
+
+/*
+    decide tells where control goes when it reaches instruction at after
+    compare and branch j, with operands loaded by a and b, had one of the
+    outcomes in known. The instructions from at on must only load registers,
+    which are not needed there, and end in a compare and branch of the same
+    values. It returns 0 when the outcome is not known.
+*/
+int decide(int j, int a, int b, int at, int known)
+{
+    int k, x, y, set, to;
+
+    for (k = at; k <= code_idx && isload(code[k].op); k++)
+	if (k > at && target[k])
+	    return 0;
+    if (k > code_idx || code[k].op < jeql || code[k].op > jleq ||
+	(k > at && target[k]))
+	return 0;
+    x = origin(at, k, LEFT(code[k].adr2));
+    y = origin(at, k, RIGHT(code[k].adr2));
+    if (x == 0 || y == 0)
+	return 0;
+    set = outcome(code[k].op);
+    if (!same(&code[x], &code[a]) || !same(&code[y], &code[b])) {
+	if (!same(&code[x], &code[b]) || !same(&code[y], &code[a]))
+	    return 0;
+	set = (set & 2) | (set >> 2 & 1) | (set << 2 & 4);
+    }
+    if ((known & ~set) == 0)
+	to = code[k].adr1;
+    else if ((known & set) == 0)
+	to = k + 1;
+    else
+	return 0;
+    for (; k >= at; k--)
+	if (defs(&code[k]) & needs(to))
+	    return 0;
+    return to;
+}
+
+/*
+    thread lets a compare and branch jump past a second one that compares the
+    same values and so has a known outcome, as IF x = 0 followed by FI x = 0
+    gives. A jump is redirected; on the fall through a jump is inserted, after
+    the instructions that do not write the values. Other paths still go to
+    the second comparison.
+*/
+void thread()
+{
+    insert_t *list = 0, *p;
+    int b, j, k, x, y, to, known, count = 0;
+
+    buildcfg();
+    liveness();
+    for (b = 0; b < nblocks; b++) {
+	j = blocks[b].last;
+	if (code[j].op < jeql || code[j].op > jleq)
+	    continue;
+	x = origin(blocks[b].first, j, LEFT(code[j].adr2));
+	y = origin(blocks[b].first, j, RIGHT(code[j].adr2));
+	if (x == 0 || y == 0)
+	    continue;
+	known = outcome(code[j].op);
+	if ((to = decide(j, x, y, code[j].adr1, known)))
+	    code[j].adr1 = to;
+	for (k = j + 1; !(to = decide(j, x, y, k, 7 & ~known)); k++)
+	    if (k == code_idx || target[k] || ends(code[k].op) ||
+		stores(&code[k], &code[x]) || stores(&code[k], &code[y]))
+		break;
+	if (to) {
+	    p = insert(&list, &count, k, 0, code_idx, 0);
+	    p->ins[p->count].op = jmp;
+	    p->ins[p->count].adr1 = to;
+	    p->ins[p->count++].adr2 = 0;
+	}
+    }
+    rebuild(list, count);
+    free(list);
+    simplify();
+}
+
+/*
+    literal returns constant x as C source; the most negative number has no
+    literal of its own.
+*/
+char *literal(int64_t x)
+{
+    static char str[32];
+
+    if (x == INT64_MIN)
+	return "INT64_MIN";
+    snprintf(str, sizeof(str), "INT64_C(%" PRId64 ")", x);
+    return str;
+}
+
+/*
+    emitc writes the program as a C translation unit. Every instruction that
+    is the target of a jump, call or return gets a label; the registers are
+    local variables and return indices are kept on the stack, as in 32syreci.
+    A return is a switch over all return indices. Arithmetic wraps around, and
+    a division by zero stops the program with the message of 32syreci.
+*/
+void emitc(char *source)
+{
+    int i, t, rets = 0, used[16] = { 0 };
+    char *label, *cmp;
+    code_t *p;
+
+    label = calloc(code_idx + 2, 1);
+    for (i = 1; i <= code_idx; i++) {
+	p = &code[i];
+	if (isjump(p->op))
+	    label[p->adr1] = 1;
+	if (p->op == cal)
+	    label[i + 1] = 1;
+	if (p->op == ret)
+	    rets = 1;
+	switch (p->op) {
+	case add: case sub: case mul: case dvd: case mdl: case eql: case neq:
+	case gtr: case geq: case lss: case leq: case orr: case mov:
+	    used[p->adr1 & 15] = used[p->adr2 & 15] = 1;
+	    break;
+	case neg: case loadglobl: case loadlocal: case loadimmed:
+	case addimmed: case addglobl: case addlocal:
+	    used[p->adr1 & 15] = 1;
+	    break;
+	case storglobl: case storlocal: case writebool: case writeint: case jiz:
+	    used[p->adr2 & 15] = 1;
+	    break;
+	case jeql: case jneq: case jgtr: case jgeq: case jlss: case jleq:
+	    used[LEFT(p->adr2)] = used[RIGHT(p->adr2)] = 1;
+	    break;
+	default:
+	    break;
+	}
+    }
+    printf("/* %s, translated by 32syrecc */\n", source);
+    printf("#include <stdio.h>\n#include <stdlib.h>\n#include <inttypes.h>\n\n");
+    printf("#define maxstack 1000\n\n");
+    printf("/* arithmetic wraps around, as in 32syreci */\n");
+    printf("#define WRAP(x, op, y) ((int64_t)((uint64_t)(x) op "
+	   "(uint64_t)(y)))\n\n");
+    printf("int64_t stack[maxstack + 1];\n\n");
+    printf("int main(void)\n{\n");
+    printf("    int64_t stacktop = 0, baseregister = 0;\n");
+    for (i = 0; i < 16; i++)
+	if (used[i])
+	    printf("    int64_t r%d = 0;\n", i);
+    printf("\n");
+    for (i = 1; i <= code_idx; i++) {
+	p = &code[i];
+	if (label[i])
+	    printf("L%d:\n", i);
+	printf("    ");
+	cmp = 0;
+	switch (p->op) {
+	case add:
+	case sub:
+	case mul:
+	    printf("r%d = WRAP(r%d, %c, r%d);\n", (int)p->adr1, (int)p->adr1,
+		   p->op == add ? '+' : p->op == sub ? '-' : '*', (int)p->adr2);
+	    break;
+	case dvd:
+	case mdl:
+	    printf("if (r%d == 0) {\n", (int)p->adr2);
+	    printf("\tprintf(\"division by zero, PC=%d, execution "
+		   "aborted\\n\");\n", i);
+	    printf("\texit(EXIT_FAILURE);\n    }\n");
+	    if (p->op == dvd)
+		printf("    r%d = r%d == -1 ? WRAP(0, -, r%d) : r%d / r%d;\n",
+		       (int)p->adr1, (int)p->adr2, (int)p->adr1,
+		       (int)p->adr1, (int)p->adr2);
+	    else
+		printf("    r%d = r%d == -1 ? 0 : r%d %% r%d;\n", (int)p->adr1,
+		       (int)p->adr2, (int)p->adr1, (int)p->adr2);
+	    break;
+	case eql:
+	    cmp = "==";
+	    break;
+	case neq:
+	    cmp = "!=";
+	    break;
+	case gtr:
+	    cmp = ">";
+	    break;
+	case geq:
+	    cmp = ">=";
+	    break;
+	case lss:
+	    cmp = "<";
+	    break;
+	case leq:
+	    cmp = "<=";
+	    break;
+	case orr:
+	    printf("r%d = r%d == 1 || r%d == 1;\n", (int)p->adr1,
+		   (int)p->adr1, (int)p->adr2);
+	    break;
+	case neg:
+	    printf("r%d = 1 - r%d;\n", (int)p->adr1, (int)p->adr1);
+	    break;
+	case loadglobl:
+	    printf("r%d = stack[%" PRId64 "];\n", (int)p->adr1, p->adr2);
+	    break;
+	case loadlocal:
+	    printf("r%d = stack[baseregister + %" PRId64 "];\n",
+		   (int)p->adr1, p->adr2);
+	    break;
+	case loadimmed:
+	    printf("r%d = %s;\n", (int)p->adr1, literal(p->adr2));
+	    break;
+	case storglobl:
+	    printf("stack[%" PRId64 "] = r%d;\n", p->adr1, (int)p->adr2);
+	    break;
+	case storlocal:
+	    printf("stack[baseregister + %" PRId64 "] = r%d;\n", p->adr1,
+		   (int)p->adr2);
+	    break;
+	case writebool:
+	    printf("puts(r%d == 1 ? \"TRUE\" : \"FALSE\");\n", (int)p->adr2);
+	    break;
+	case writeint:
+	    printf("printf(\"%%12\" PRId64 \"\\n\", r%d);\n", (int)p->adr2);
+	    break;
+	case cal:
+	    printf("if (stacktop + %" PRId64 " > maxstack) {\n", p->adr2);
+	    printf("\tprintf(\"stack overflow, PC=%d, execution aborted\\n\");\n",
+		   i);
+	    printf("\texit(EXIT_FAILURE);\n    }\n");
+	    printf("    stack[stacktop + 1] = baseregister;\n");
+	    printf("    stack[stacktop + 2] = %d;\n", i + 1);
+	    printf("    baseregister = stacktop;\n");
+	    printf("    stacktop += %" PRId64 ";\n", p->adr2);
+	    printf("    goto L%" PRId64 ";\n", p->adr1);
+	    break;
+	case ret:
+	    printf("stacktop = baseregister;\n");
+	    printf("    baseregister = stack[stacktop + 1];\n");
+	    printf("    goto ret;\n");
+	    break;
+	case jmp:
+	    printf("goto L%" PRId64 ";\n", p->adr1);
+	    break;
+	case jiz:
+	    printf("if (r%d == 0)\n\tgoto L%" PRId64 ";\n", (int)p->adr2,
+		   p->adr1);
+	    break;
+	case hlt:
+	    printf("return EXIT_SUCCESS;\n");
+	    break;
+	case addimmed:
+	    printf("r%d = WRAP(r%d, +, %s);\n", (int)p->adr1, (int)p->adr1,
+		   literal(p->adr2));
+	    break;
+	case addglobl:
+	    printf("r%d = WRAP(r%d, +, stack[%" PRId64 "]);\n", (int)p->adr1,
+		   (int)p->adr1, p->adr2);
+	    break;
+	case addlocal:
+	    printf("r%d = WRAP(r%d, +, stack[baseregister + %" PRId64 "]);\n",
+		   (int)p->adr1, (int)p->adr1, p->adr2);
+	    break;
+	case setglobl:
+	    printf("stack[%" PRId64 "] = %s;\n", p->adr1, literal(p->adr2));
+	    break;
+	case setlocal:
+	    printf("stack[baseregister + %" PRId64 "] = %s;\n", p->adr1,
+		   literal(p->adr2));
+	    break;
+	case incglobl:
+	    printf("stack[%" PRId64 "] = WRAP(stack[%" PRId64 "], +, %s);\n",
+		   p->adr1, p->adr1, literal(p->adr2));
+	    break;
+	case inclocal:
+	    printf("stack[baseregister + %" PRId64 "] =\n\tWRAP(stack["
+		   "baseregister + %" PRId64 "], +, %s);\n", p->adr1, p->adr1,
+		   literal(p->adr2));
+	    break;
+	case jeql:
+	case jneq:
+	case jgtr:
+	case jgeq:
+	case jlss:
+	case jleq:
+	    t = p->op - jeql;
+	    printf("if (r%d %s r%d)\n\tgoto L%" PRId64 ";\n",
+		   (int)LEFT(p->adr2), t == 0 ? "==" : t == 1 ? "!=" :
+		   t == 2 ? ">" : t == 3 ? ">=" : t == 4 ? "<" : "<=",
+		   (int)RIGHT(p->adr2), p->adr1);
+	    break;
+	case mov:
+	    printf("r%d = r%d;\n", (int)p->adr1, (int)p->adr2);
+	    break;
+	default:
+	    printf(";\n");
+	    break;
+	}
+	if (cmp)
+	    printf("r%d = r%d %s r%d;\n", (int)p->adr1, (int)p->adr1, cmp,
+		   (int)p->adr2);
+    }
+    if (rets) {
+	printf("ret:\n    switch (stack[stacktop + 2]) {\n");
+	for (i = 1; i <= code_idx; i++)
+	    if (code[i].op == cal)
+		printf("    case %d:\n\tgoto L%d;\n", i + 1, i + 1);
+	printf("    }\n");
+    }
+    printf("    return EXIT_FAILURE;\n}\n");
+    free(label);
+}
+
+/*
+    translate compiles the program in fp into the code array and optimizes
+    it. The number of errors is returned.
+*/
+int translate(FILE *fp)
+{
+    closescope(0);		/* from an earlier translation */
+    free(source);
+    free(code);
+    code_idx = codeline = linenum = 1;
+    procname_idx = global_idx = local_idx = regnum = errors = patched = 0;
+    symbol = 0;
+    pending[0] = pending[1] = 0;
+    readsource(fp);
+    code = malloc((code_max = MAXPRG) * sizeof(code_t));
+    program();
+    if (level > 0 && !errors) {
+	if (level > 1)
+	    inlining();
+	constprop();
+	deadcode();
+	if (level > 1) {
+	    simplify();
+	    numbering();
+	    deadcode();
+	    deadstores();
+	    deadcode();
+	    promote();
+	    propagate();
+	}
+	fuse();
+	if (level > 1) {
+	    thread();
+	    propagate();
+	    hoist();
+	}
+    }
+    return errors;
+}
+
+/*
+    include adds n to a set of bits, and tells whether it was new.
+*/
+int include(uint64_t *set, int n)
+{
+    if (set[n / 64] >> n % 64 & 1)
+	return 0;
+    set[n / 64] |= (uint64_t)1 << n % 64;
+    return 1;
+}
+
+/*
+    flow meets the set s with the set before an instruction, or sets it when
+    first is set, and tells whether the instruction must be visited again.
+*/
+int flow(uint64_t *set, uint64_t *s, int words, int first)
+{
+    int w, again = first;
+
+    for (w = 0; w < words; w++)
+	if (first)
+	    set[w] = s[w];
+	else if (set[w] & ~s[w]) {
+	    set[w] &= s[w];
+	    again = 1;
+	}
+    return again;
+}
+
+/*
+    purity finds what the procedures do with the global variables, see
+    pure_t, and returns the number of procedures, the procedures in procs and
+    the number of global variables in globals. Only the procedures that can
+    be reached from the call at instruction 1 are listed. A procedure is
+    followed from its entry with the set of variables that are surely written
+    before each instruction; local variable n is bit globals + n of that set.
+    A call adds the sets of the procedure that it calls. As procedures can
+    call each other, this is repeated until no set changes, starting from
+    procedures that read and write nothing and write every variable when they
+    return.
+*/
+int purity(pure_t **procs, int *globals)
+{
+    int i, k, n = 0, g, t, top, words, frame = 0, changed, *procof, *work;
+    uint64_t *state, *s, *out;
+    char *seen;
+    pure_t *p, *q;
+    code_t *c;
+
+    procof = calloc(code_idx + 2, sizeof(int));
+    for (*globals = 0, i = 1; i <= code_idx; i++) {
+	c = &code[i];
+	g = c->op == loadglobl || c->op == addglobl ? c->adr2 + 1 :
+	    c->op == storglobl || c->op == setglobl || c->op == incglobl ?
+	    c->adr1 + 1 : 0;
+	if (*globals < g)
+	    *globals = g;
+    }
+    seen = calloc(code_idx + 2, 1);
+    work = malloc((code_idx + 2) * sizeof(int));
+    for (seen[work[0] = 1] = 1, top = 1; top; ) {
+	c = &code[i = work[--top]];
+	if (c->op == cal && i > 1) {
+	    if (!procof[c->adr1])
+		procof[c->adr1] = ++n;
+	    if (frame < c->adr2)
+		frame = c->adr2;
+	}
+	for (g = 0; g < 2; g++) {
+	    if (g ? !isjump(c->op) : c->op == jmp || c->op == ret ||
+		c->op == hlt)
+		continue;
+	    t = g ? c->adr1 : i + 1;
+	    if (t <= code_idx && !seen[t])
+		seen[work[top++] = t] = 1;
+	}
+    }
+    words = (*globals + frame) / 64 + 1;
+    *procs = calloc(n ? n : 1, sizeof(pure_t));
+    for (i = 2; i <= code_idx; i++) {
+	if (code[i].op != cal || !seen[i])
+	    continue;
+	p = &(*procs)[procof[code[i].adr1] - 1];
+	if (p->reads)
+	    continue;
+	p->entry = code[i].adr1;
+	p->reads = calloc(3 * words, sizeof(uint64_t));
+	p->writes = p->reads + words;
+	p->surely = p->writes + words;
+	for (g = 0; g < *globals; g++)
+	    include(p->surely, g);
+    }
+    state = malloc((size_t)(code_idx + 2) * words * sizeof(uint64_t));
+    s = malloc(2 * words * sizeof(uint64_t));
+    out = s + words;
+    do {
+	changed = 0;
+	for (k = 0; k < n; k++) {
+	    p = &(*procs)[k];
+	    memset(seen, 0, code_idx + 2);
+	    memset(s, 0, words * sizeof(uint64_t));
+	    memset(out, -1, words * sizeof(uint64_t));
+	    flow(&state[(size_t)p->entry * words], s, words, 1);
+	    seen[work[0] = p->entry] = 2;
+	    for (top = 1; top; ) {
+		c = &code[i = work[--top]];
+		seen[i] = 1;
+		memcpy(s, &state[(size_t)i * words], words * sizeof(uint64_t));
+		switch (c->op) {
+		case loadglobl:
+		case addglobl:
+		    if (!(s[c->adr2 / 64] >> c->adr2 % 64 & 1))
+			changed |= include(p->reads, c->adr2);
+		    break;
+		case incglobl:
+		    if (!(s[c->adr1 / 64] >> c->adr1 % 64 & 1))
+			changed |= include(p->reads, c->adr1);
+		    /* fall through */
+		case storglobl:
+		case setglobl:
+		    changed |= include(p->writes, c->adr1);
+		    include(s, c->adr1);
+		    break;
+		case loadlocal:
+		case addlocal:
+		case inclocal:
+		    g = *globals + (c->op == inclocal ? c->adr1 : c->adr2);
+		    if (!(s[g / 64] >> g % 64 & 1) && !p->impure)
+			changed = p->impure = 1;
+		    break;
+		case storlocal:
+		case setlocal:
+		    if (c->adr1 < 3 && !p->impure)
+			changed = p->impure = 1;
+		    include(s, *globals + c->adr1);
+		    break;
+		case writebool:
+		case writeint:
+		case hlt:
+		    if (!p->impure)
+			changed = p->impure = 1;
+		    break;
+		case cal:
+		    q = &(*procs)[procof[c->adr1] - 1];
+		    if (q->impure && !p->impure)
+			changed = p->impure = 1;
+		    for (g = 0; g < words; g++) {
+			if ((q->reads[g] & ~s[g] & ~p->reads[g]) ||
+			    (q->writes[g] & ~p->writes[g]))
+			    changed = 1;
+			p->reads[g] |= q->reads[g] & ~s[g];
+			p->writes[g] |= q->writes[g];
+			s[g] |= q->surely[g];
+		    }
+		    break;
+		case ret:
+		    for (g = 0; g < words; g++)
+			out[g] &= s[g];
+		    break;
+		default:
+		    break;
+		}
+		for (g = 0; g < 2; g++) {
+		    if (g ? !isjump(c->op) || c->op == cal :
+			c->op == jmp || c->op == ret || c->op == hlt)
+			continue;
+		    t = g ? c->adr1 : i + 1;
+		    if (flow(&state[(size_t)t * words], s, words, !seen[t]) &&
+			seen[t] != 2)
+			seen[work[top++] = t] = 2;
+		}
+	    }
+	    for (g = 0; g < words; g++)
+		if (p->surely[g] & ~out[g]) {
+		    p->surely[g] &= out[g];
+		    changed = 1;
+		}
+	}
+    } while (changed);
+    free(work);
+    free(seen);
+    free(s);
+    free(state);
+    free(procof);
+    return n;
+}
+
+/*
+    iskey tells whether global variable g is in the key of procedure p: it
+    can read g before writing it, or it does not write g whenever it returns,
+    so that g can keep its value from before the call.
+*/
+int iskey(pure_t *p, int g)
+{
+    return (p->reads[g / 64] | (p->writes[g / 64] & ~p->surely[g / 64])) >>
+	   g % 64 & 1;
+}
+
+int iswritten(pure_t *p, int g)
+{
+    return p->writes[g / 64] >> g % 64 & 1;
+}
+
+void freepure(pure_t *procs, int n)
+{
+    int k;
+
+    for (k = 0; k < n; k++)
+	free(procs[k].reads);
+    free(procs);
+}
+
+/*
+    assemble returns the bytecode file for the code array in one buffer, as
+    dump would write it. A LOADIMMED of a constant that does not fit in adr2
+    becomes a LOADCONST of a constant in the pool. The table of pure
+    procedures follows, when there are any, and when lines is set, the line
+    table. The size of the file is returned in size.
+*/
+char *assemble(size_t *size, int lines)
+{
+    int i, g, k, ranges = 0, nprocs, npure = 0, nvars = 0, globals,
+	*offset = 0;
+    char *file, *names;
+    size_t length = 0;
+    header *hdr;
+    instruction *image;
+    int64_t adr2, *pool;
+    puretable *pure;
+    pureproc *proc;
+    pure_t *procs, *p;
+    linetable *table;
+    uint32_t *line, *var;
+    procrange *range;
+
+    for (*size = 0, i = 1; i <= code_idx; i++)
+	if (code[i].op == loadimmed && !SHORT(code[i].adr2))
+	    (*size)++;
+    *size = sizeof(header) + (code_idx + 1) * sizeof(instruction) +
+	    *size * sizeof(int64_t);
+    nprocs = purity(&procs, &globals);
+    for (k = 0; k < nprocs; k++)
+	if (!procs[k].impure) {
+	    npure++;
+	    for (g = 0; g < globals; g++)
+		nvars += iskey(&procs[k], g) + iswritten(&procs[k], g);
+	}
+    if (npure)
+	*size += sizeof(puretable) + npure * sizeof(pureproc) +
+		 nvars * sizeof(uint32_t);
+    if (lines) {
+	offset = malloc(procname_idx * sizeof(int));
+	for (i = 0; i < procname_idx; i++) {
+	    offset[i] = length;
+	    length += strlen(procnames[i]) + 1;
+	}
+	for (i = 1; i <= code_idx; i++)
+	    if (i == 1 || code[i].proc != code[i - 1].proc)
+		ranges++;
+	*size += sizeof(linetable) + (code_idx + 1) * sizeof(uint32_t) +
+		 ranges * sizeof(procrange) + length;
+    }
+    file = malloc(*size);
+    hdr = (header *)file;
+    memcpy(hdr->magic, MAGIC, sizeof(hdr->magic));
+    hdr->version = VERSION;
+    hdr->codesize = code_idx + 1;
+    hdr->poolsize = 0;
+    image = (instruction *)(hdr + 1);
+    pool = (int64_t *)(image + hdr->codesize);
+    image[0].op = hlt;
+    image[0].adr1 = image[0].adr2 = 0;
+    for (i = 1; i <= code_idx; i++) {
+	image[i].op = code[i].op;
+	adr2 = code[i].adr2;
+	if (code[i].op == loadimmed && !SHORT(adr2)) {
+	    pool[hdr->poolsize] = adr2;
+	    adr2 = hdr->poolsize++;
+	    image[i].op = loadconst;
+	}
+	if (code[i].adr1 < 0 || code[i].adr1 > MAXADR1 || !SHORT(adr2)) {
+	    fprintf(stderr, "%d %s (operand out of range)\n", i,
+		    operator_NAMES[code[i].op]);
+	    free(offset);
+	    free(file);
+	    freepure(procs, nprocs);
+	    return 0;
+	}
+	image[i].adr1 = code[i].adr1;
+	image[i].adr2 = adr2;
+    }
+    table = (linetable *)(pool + hdr->poolsize);
+    if (npure) {
+	pure = (puretable *)table;
+	memcpy(pure->magic, PUREMAGIC, sizeof(pure->magic));
+	pure->procsize = npure;
+	pure->varsize = nvars;
+	proc = (pureproc *)(pure + 1);
+	var = (uint32_t *)(proc + npure);
+	for (k = 0; k < nprocs; k++) {
+	    if ((p = &procs[k])->impure)
+		continue;
+	    proc->entry = p->entry;
+	    proc->keys = proc->writes = 0;
+	    for (g = 0; g < globals; g++)
+		if (iskey(p, g)) {
+		    *var++ = g;
+		    proc->keys++;
+		}
+	    for (g = 0; g < globals; g++)
+		if (iswritten(p, g)) {
+		    *var++ = g;
+		    proc->writes++;
+		}
+	    proc++;
+	}
+	table = (linetable *)var;
+    }
+    if (lines) {
+	memcpy(table->magic, LINEMAGIC, sizeof(table->magic));
+	table->procsize = ranges;
+	table->namesize = length;
+	line = (uint32_t *)(table + 1);
+	range = (procrange *)(line + code_idx + 1);
+	names = (char *)(range + ranges);
+	line[0] = 0;
+	for (ranges = 0, i = 1; i <= code_idx; i++) {
+	    line[i] = code[i].line;
+	    if (i == 1 || code[i].proc != code[i - 1].proc) {
+		range[ranges].first = i;
+		range[ranges++].name = offset[code[i].proc];
+	    }
+	}
+	for (i = 0; i < procname_idx; i++)
+	    strcpy(names + offset[i], procnames[i]);
+	free(offset);
+    }
+    freepure(procs, nprocs);
+    return file;
+}
+
+#ifndef NOMAIN
+int main(int argc, char *argv[])
+{
+    int i, emit = 0, list = 0, lines = 0;
+    char *output = 0, *file;
+    size_t size;
+    FILE *fp;
+
+    for (; argc > 1 && argv[1][0] == '-'; argc--, argv++)
+	if (!strcmp(argv[1], "-c"))
+	    emit = 1;
+	else if (!strcmp(argv[1], "-l"))
+	    list = 1;
+	else if (!strcmp(argv[1], "-g"))
+	    lines = 1;
+	else if (!strcmp(argv[1], "-v"))
+	    verbose = 1;
+	else if (!strcmp(argv[1], "-o") && argc > 2) {
+	    output = argv[2];
+	    argc--;
+	    argv++;
+	} else if (argv[1][1] == 'O' && argv[1][2] >= '0' && argv[1][2] <= '2' &&
+		 !argv[1][3])
+	    level = argv[1][2] - '0';
+	else {
+	    fprintf(stderr, "usage: 32syrecc [-c] [-g] [-l] [-v] [-O0|-O1|-O2] "
+		    "[-o bytecode] [file]\n");
+	    exit(EXIT_FAILURE);
+	}
+    if (argc == 2 && !freopen(argv[1], "r", stdin)) {
+	fprintf(stderr, "failed to open the file '%s'.\n", argv[1]);
+	exit(EXIT_FAILURE);
+    }
+    if (translate(stdin))
+	exit(EXIT_FAILURE);
+    if (emit) {
+	emitc(argc == 2 ? argv[1] : "stdin");
+	exit(EXIT_SUCCESS);
+    }
+    if (output) {
+	if ((file = assemble(&size, lines)) == 0)
+	    exit(EXIT_FAILURE);
+	if ((fp = fopen(output, "wb")) == 0 ||
+	    fwrite(file, 1, size, fp) != size || fclose(fp)) {
+	    fprintf(stderr, "%s (cannot create)\n", output);
+	    exit(EXIT_FAILURE);
+	}
+    }
+    if (!output || list)
+	for (i = 1; i <= code_idx; i++)
+	    printf("%8d%15s %11" PRId64 " %11" PRId64 "\n",
+		    i, operator_NAMES[code[i].op], code[i].adr1, code[i].adr2);
     exit(EXIT_SUCCESS);
 }
+#endif
@@ -1,202 +1,152 @@
 /*
     module  : 32syreci.c
-    version : 1.5
-    date    : 08/17/23
+    version : 1.24
+    date    : 10/17/26
 */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 #include <inttypes.h>
+#include <signal.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 #include "32syreci.h"
+#include "syreci.h"
 
 /* SYmboltable, RECursion, Interpreter only,
    interprets a file of instructions produced by syrecc */
 
-#define showcode false
-#define tracing false
+/*
+    With -c the program runs in slices of this many instructions, and a
+    snapshot is written between two slices.
+*/
+#define snapslice 1000000
 
-#define maxcode 200
-#define maxstack 1000
-#define topregister 7
+static volatile sig_atomic_t snaprequest;
 
-void debug(instruction *pc, instruction *code)
+static void requestsnap(int signum)
 {
-    printf("%12" PRId64 "%12.12s%12" PRId64 "%12" PRId64 "\n",
-	pc - code, operator_NAMES[pc->op], pc->adr1, pc->adr2);
+    snaprequest = 1;
 }
 
+/*
+    The virtual machine is in libsyreci; 32syreci loads one program, compiling
+    it first when it is a source file, runs it, and prints the reports of the
+    profilers. With -b it runs a batch of programs, in batch.c, and with -m
+    many programs at the same time, in sched.c. With -k it answers calls of
+    pure procedures from a cache. With -c it writes a snapshot of the machine
+    when it receives SIGUSR1, or after -n instructions, and then stops; with
+    -r it continues the program from a snapshot.
+*/
 int main(int argc, char *argv[])
 { /* main */
+    size_t size;
+    char *filename, *file, *save = 0, *restore = 0;
     FILE *fp;
-    char *filename;
-    instruction code[maxcode], *pc;
-
-    int64_t stack[maxstack + 1];
-    int64_t stacktop = 0;
-    int64_t reg[topregister + 1];
-    int64_t baseregister = 0;
+    syreci *vm;
+    syreci_status status;
+    int options = 0;
+    int64_t checkpoint = 0, budget;
 
     printf("SYRECI ...\n");
-
-    filename = argc == 2 ? argv[1] : inputfile;
-    if ((fp = fopen(filename, "rb")) == NULL) {
-	fprintf(stderr, "%s (file not found)\n", filename);
+    for (; argc > 1 && argv[1][0] == '-'; argc--, argv++)
+	if (!strcmp(argv[1], "-j"))
+	    options |= SYRECI_JIT;
+	else if (!strcmp(argv[1], "-k"))
+	    options |= SYRECI_MEMO;
+	else if (!strcmp(argv[1], "-p") &&
+		 !(options & ~(SYRECI_JIT | SYRECI_MEMO)))
+	    options |= SYRECI_PROFILE;
+#ifndef _WIN32
+	else if (!strcmp(argv[1], "-s") &&
+		 !(options & ~(SYRECI_JIT | SYRECI_MEMO)))
+	    options |= SYRECI_SAMPLE;
+#endif
+	else if (!strcmp(argv[1], "-e") &&
+		 !(options & ~(SYRECI_JIT | SYRECI_MEMO)))
+	    options |= SYRECI_EVENTS;
+	else if (!strcmp(argv[1], "-c") && argc > 2)
+	    save = argv[2], argc--, argv++;
+	else if (!strcmp(argv[1], "-n") && argc > 2 &&
+		 (checkpoint = atoll(argv[2])) > 0)
+	    argc--, argv++;
+	else if (!strcmp(argv[1], "-r") && argc > 2)
+	    restore = argv[2], argc--, argv++;
+	else if (!strcmp(argv[1], "-b") && !(options & ~SYRECI_JIT))
+	    exit(batch(argc - 1, argv + 1, options));
+	else if (!strcmp(argv[1], "-m") && !options)
+	    exit(schedule(argc - 1, argv + 1, options));
+	else {
+	    fprintf(stderr,
+		    "usage: 32syreci [-j] [-k] [-p | -s | -e] [-c snapshot "
+		    "[-n count]]\n"
+		    "                [-r snapshot] [file | file.inp]\n"
+		    "       32syreci -b [-j] [-t threads] [-o dir] "
+		    "file... | dir\n"
+		    "       32syreci -m [-q quantum] file[:priority]...\n");
+	    exit(EXIT_FAILURE);
+	}
+    if ((vm = syreci_create()) == 0) {
+	fprintf(stderr, "%s\n", syreci_message(SYRECI_MEMORY));
 	exit(EXIT_FAILURE);
     }
-    for (pc = &code[1]; fread(pc, sizeof(instruction), 1, fp); pc++)
-	if (showcode)
-	    debug(pc, code);
-    fclose(fp);
-
-    /* interpret: */
-    if (tracing)
-	printf("interpreting ...\n");
-    pc = &code[1];
-    for (;;) {
-	if (tracing)
-	    debug(pc, code);
-	switch (pc->op) {
-	case add:
-	    reg[pc->adr1] += reg[pc->adr2];
-	    pc++;
-	    break;
-
-	case sub:
-	    reg[pc->adr1] -= reg[pc->adr2];
-	    pc++;
-	    break;
-
-	case mul:
-	    reg[pc->adr1] *= reg[pc->adr2];
-	    pc++;
-	    break;
-
-	case dvd:
-	    reg[pc->adr1] /= reg[pc->adr2];
-	    pc++;
-	    break;
-
-	case mdl:
-	    reg[pc->adr1] %= reg[pc->adr2];
-	    pc++;
-	    break;
-
-	case eql:
-	    reg[pc->adr1] = reg[pc->adr1] == reg[pc->adr2];
-	    pc++;
-	    break;
-
-	case neq:
-	    reg[pc->adr1] = reg[pc->adr1] != reg[pc->adr2];
-	    pc++;
-	    break;
-
-	case gtr:
-	    reg[pc->adr1] = reg[pc->adr1] > reg[pc->adr2];
-	    pc++;
-	    break;
-
-	case geq:
-	    reg[pc->adr1] = reg[pc->adr1] >= reg[pc->adr2];
-	    pc++;
-	    break;
-
-	case lss:
-	    reg[pc->adr1] = reg[pc->adr1] < reg[pc->adr2];
-	    pc++;
-	    break;
-
-	case leq:
-	    reg[pc->adr1] = reg[pc->adr1] <= reg[pc->adr2];
-	    pc++;
-	    break;
-
-	case orr:
-	    reg[pc->adr1] = reg[pc->adr1] == 1 || reg[pc->adr2] == 1;
-	    pc++;
-	    break;
-
-	case neg:
-	    reg[pc->adr1] = 1 - reg[pc->adr1];
-	    pc++;
-	    break;
-
-	case loadglobl:
-	    reg[pc->adr1] = stack[pc->adr2];
-	    pc++;
-	    break;
-
-	case loadlocal:
-	    reg[pc->adr1] = stack[pc->adr2 + baseregister];
-	    pc++;
-	    break;
-
-	case loadimmed:
-	    reg[pc->adr1] = pc->adr2;
-	    pc++;
-	    break;
-
-	case storglobl:
-	    stack[pc->adr1] = reg[pc->adr2];
-	    pc++;
-	    break;
-
-	case storlocal:
-	    stack[pc->adr1 + baseregister] = reg[pc->adr2];
-	    pc++;
-	    break;
-
-	case writebool:
-	    puts(reg[pc->adr2] == 1 ? "TRUE" : "FALSE");
-	    pc++;
-	    break;
-
-	case writeint:
-	    printf("%12" PRId64 "\n", reg[pc->adr2]);
-	    pc++;
-	    break;
-
-	case cal:
-	    if (stacktop + pc->adr2 > maxstack) {
-		printf("stack overflow, PC=%" PRId64 ", execution aborted\n",
-			pc - code);
-		exit(EXIT_FAILURE);
-	    }
-	    stack[stacktop + 1] = baseregister;
-	    stack[stacktop + 2] = pc + 1 - code;
-	    baseregister = stacktop;
-	    stacktop += pc->adr2;
-	    pc = &code[pc->adr1];
-	    break;
-
-	case ret:
-	    stacktop = baseregister;
-	    baseregister = stack[stacktop + 1];
-	    pc = &code[stack[stacktop + 2]];
-	    break;
-
-	case jmp:
-	    pc = &code[pc->adr1];
-	    break;
-
-	case jiz:
-	    if (reg[pc->adr2] == 0)
-		pc = &code[pc->adr1];
-	    else
-		pc++;
-	    break;
-
-	case hlt:
-	    exit(EXIT_SUCCESS);
-
-	default:
-#ifdef _MSC_VER
-	    __assume(0);
-#else
-	    __builtin_unreachable();
+#ifndef _WIN32
+    if (isatty(STDOUT_FILENO))
+	syreci_output(vm, 0, 0, true);
 #endif
+    filename = argc == 2 ? argv[1] : inputfile;
+    size = strlen(filename);
+    if (size > 4 && !strcmp(filename + size - 4, ".inp")) {
+	if ((fp = fopen(filename, "r")) == 0 || translate(fp) ||
+	    (file = assemble(&size, 1)) == 0) {
+	    fprintf(stderr, "%s (cannot compile)\n", filename);
+	    exit(EXIT_FAILURE);
 	}
+	fclose(fp);
+	status = syreci_loadbuffer(vm, file, size, options);
+	free(file);
+    } else
+	status = syreci_load(vm, filename, options);
+    if (status != SYRECI_OK) {
+	fprintf(stderr, "%s (%s)\n", filename, syreci_error(vm));
+	exit(EXIT_FAILURE);
+    }
+    if (restore && (status = syreci_restore(vm, restore)) != SYRECI_OK) {
+	fprintf(stderr, "%s (%s)\n", restore, syreci_message(status));
+	exit(EXIT_FAILURE);
+    }
+    if (save) {
+#ifdef SIGUSR1
+	signal(SIGUSR1, requestsnap);
+#endif
+	do {
+	    budget = snapslice;
+	    if (checkpoint && checkpoint - syreci_executed(vm) < budget)
+		budget = checkpoint - syreci_executed(vm);
+	    if ((status = syreci_run(vm, budget)) != SYRECI_BUDGET)
+		break;
+	    if (snaprequest ||
+		(checkpoint && syreci_executed(vm) >= checkpoint)) {
+		if ((status = syreci_save(vm, save)) != SYRECI_OK) {
+		    fprintf(stderr, "%s (%s)\n", save, syreci_message(status));
+		    exit(EXIT_FAILURE);
+		}
+		syreci_report(vm, stderr);
+		syreci_destroy(vm);
+		exit(EXIT_SUCCESS);
+	    }
+	} while (true);
+    } else
+	status = syreci_run(vm, 0);
+    syreci_report(vm, stderr);
+    if (status != SYRECI_HALT) {
+	printf("%s, PC=%d, execution aborted\n", syreci_message(status),
+	       (int)syreci_pc(vm));
+	exit(EXIT_FAILURE);
     }
+    syreci_destroy(vm);
     exit(EXIT_SUCCESS);
 } /* main */
 
@@ -1,13 +1,52 @@
 /*
     module  : 32syreci.h
-    version : 1.1
-    date    : 08/17/23
+    version : 1.11
+    date    : 10/17/26
 */
 
 /* ----------------------------- D E F I N E S ----------------------------- */
 
 #define inputfile "32syreci.tmp"
 
+/*
+    A bytecode file starts with a header, followed by the instructions and the
+    pool of constants that do not fit in adr2. Instruction 0 is not executed.
+*/
+#define MAGIC	"SYRE"
+#define VERSION	1
+
+/*
+    An optional table of pure procedures can follow the pool: procedures that
+    write no output and only change global variables, of which the values
+    after a call depend on the values of the variables in the key of the
+    procedure before the call. For each procedure the table gives its entry
+    and the sizes of its key and of the variables that it writes; the offsets
+    of these variables follow the procedures, the key of each procedure first.
+*/
+#define PUREMAGIC	"PURE"
+
+/*
+    An optional line table can follow the pool and the table of pure
+    procedures: the source line of each instruction, followed by the
+    procedures as ranges of instructions, each range ending where the next
+    one begins, and the names of the procedures.
+*/
+#define LINEMAGIC	"LINE"
+
+/*
+    adr1 is an unsigned 24 bit field, adr2 a signed 32 bit field.
+*/
+#define MAXADR1	0xFFFFFF
+#define SHORT(x)	((x) >= INT32_MIN && (x) <= INT32_MAX)
+
+/*
+    The compare and branch superinstructions jeql .. jleq compare two registers
+    that are packed in adr2 and jump to adr1 when the comparison holds.
+*/
+#define PAIR(a, b)	((a) | (b) << 4)
+#define LEFT(x)		((x) & 15)
+#define RIGHT(x)	((x) >> 4)
+
 typedef enum {
     add,
     sub,
@@ -33,19 +72,68 @@ typedef enum {
     ret,
     jmp,
     jiz,
-    hlt
+    hlt,
+    /* superinstructions, selected by the compiler */
+    addimmed,
+    addglobl,
+    addlocal,
+    setglobl,
+    setlocal,
+    incglobl,
+    inclocal,
+    jeql,
+    jneq,
+    jgtr,
+    jgeq,
+    jlss,
+    jleq,
+    /* loads a constant from the pool */
+    loadconst,
+    /* copies a register to a register that holds a variable */
+    mov
 } operator;
 
 /* ------------------------------- T Y P E S ------------------------------- */
 
+typedef struct header {
+    char magic[4];
+    uint32_t version,
+	codesize,	/* number of instructions, including instruction 0 */
+	poolsize;	/* number of constants */
+} header;
+
+typedef struct linetable {
+    char magic[4];
+    uint32_t procsize,	/* number of procedure ranges */
+	namesize;	/* size of the names, including their null characters */
+} linetable;
+
+typedef struct procrange {
+    uint32_t first,	/* first instruction of the range */
+	name;		/* offset of the name of the procedure in the names */
+} procrange;
+
+typedef struct puretable {
+    char magic[4];
+    uint32_t procsize,	/* number of pure procedures */
+	varsize;	/* number of offsets of variables */
+} puretable;
+
+typedef struct pureproc {
+    uint32_t entry,	/* first instruction of the procedure */
+	keys,		/* number of variables in the key */
+	writes;		/* number of variables that it writes */
+} pureproc;
+
 typedef struct instruction {
-    operator op;
-    int64_t adr1, adr2;
+    uint32_t op : 8,
+	adr1 : 24;	/* register, target, or offset */
+    int32_t adr2;	/* register, offset, immediate, or frame size */
 } instruction;
 
 /* --------------------------- V A R I A B L E S --------------------------- */
 
-char *operator_NAMES[] = {
+static const char *const operator_NAMES[] = {
     "ADD",
     "SUB",
     "MUL",
@@ -70,5 +158,39 @@ char *operator_NAMES[] = {
     "RET",
     "JMP",
     "JIZ",
-    "HLT"
+    "HLT",
+    "ADDIMMED",
+    "ADDGLOBL",
+    "ADDLOCAL",
+    "SETGLOBL",
+    "SETLOCAL",
+    "INCGLOBL",
+    "INCLOCAL",
+    "JEQL",
+    "JNEQ",
+    "JGTR",
+    "JGEQ",
+    "JLSS",
+    "JLEQ",
+    "LOADCONST",
+    "MOV"
 };
+
+/* --------------------------- F U N C T I O N S --------------------------- */
+
+/*
+    The compiler, in 32syrecc.c, compiled with NOMAIN when linked with the
+    interpreter.
+*/
+int translate(FILE *fp);
+char *assemble(size_t *size, int lines);
+
+/*
+    The batch runner of 32syreci -b, in batch.c.
+*/
+int batch(int argc, char *argv[], int options);
+
+/*
+    The scheduler of 32syreci -m, in sched.c.
+*/
+int schedule(int argc, char *argv[], int options);
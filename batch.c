@@ -0,0 +1,431 @@
+/*
+    module  : batch.c
+    version : 1.2
+    date    : 10/17/26
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#ifndef _WIN32
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+#include "32syreci.h"
+#include "syreci.h"
+
+/*
+    32syreci -b runs a batch of programs on a pool of worker threads. Each
+    distinct file is mapped once and its image is shared by the jobs that run
+    it. The jobs are dealt to the workers in turn; a worker takes its own jobs
+    from the front, in order, and when it has none left, steals from the back
+    of another worker. The output of a job is collected in memory and written
+    to stdout in the order of the jobs, or written to a file of its own in a
+    directory. A worker that cannot be started leaves its jobs to the others
+    to steal. The throughput and the percentiles of the latency of the jobs
+    are printed to stderr.
+*/
+#ifndef _WIN32
+typedef struct image_t {
+    char *name;
+    void *file;
+    size_t size;
+    bool compiled;		/* file is allocated by assemble */
+} image_t;
+
+typedef struct job_t {
+    image_t *image;
+    FILE *fp;			/* the output file, with -o */
+    char *out;			/* the output, without -o */
+    char *error;		/* why the program cannot be loaded */
+    size_t outlen, outmax;
+    syreci_status status;
+    double latency;		/* seconds from loading to stopping */
+    bool skipped,		/* the job cannot run */
+	done;
+} job_t;
+
+typedef struct worker_t {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    uint32_t *jobs, first, last;	/* jobs[first .. last - 1] are left */
+    bool started;
+} worker_t;
+
+typedef struct outname_t {
+    char *base;
+    int job;
+} outname_t;
+
+static job_t *jobs;
+static worker_t *workers;
+static int workercount, options;
+static pthread_mutex_t donelock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t doneflag = PTHREAD_COND_INITIALIZER;
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+    collect adds output of the program to the job.
+*/
+static void collect(void *context, const char *buf, size_t size)
+{
+    job_t *job = context;
+
+    if (job->fp) {
+	fwrite(buf, 1, size, job->fp);
+	return;
+    }
+    if (job->outlen + size > job->outmax) {
+	job->outmax = job->outmax * 2 > job->outlen + size ?
+		      job->outmax * 2 : job->outlen + size;
+	job->out = realloc(job->out, job->outmax);
+    }
+    memcpy(job->out + job->outlen, buf, size);
+    job->outlen += size;
+}
+
+/*
+    take returns the next job of worker w, or of another worker when w has
+    none left, or -1 when all jobs are taken.
+*/
+static int64_t take(int w)
+{
+    int i;
+    int64_t j = -1;
+    worker_t *worker = &workers[w];
+
+    pthread_mutex_lock(&worker->lock);
+    if (worker->first < worker->last)
+	j = worker->jobs[worker->first++];
+    pthread_mutex_unlock(&worker->lock);
+    for (i = 1; j < 0 && i < workercount; i++) {
+	worker = &workers[(w + i) % workercount];
+	pthread_mutex_lock(&worker->lock);
+	if (worker->first < worker->last)
+	    j = worker->jobs[--worker->last];
+	pthread_mutex_unlock(&worker->lock);
+    }
+    return j;
+}
+
+/*
+    work runs jobs with one machine, that each job loads again.
+*/
+static void *work(void *arg)
+{
+    int w = (intptr_t)arg;
+    int64_t j;
+    job_t *job;
+    syreci *vm = syreci_create();
+    double start;
+    char buf[80];
+
+    while ((j = take(w)) >= 0) {
+	job = &jobs[j];
+	start = now();
+	if (!vm)
+	    job->status = SYRECI_MEMORY;
+	else if ((job->status = syreci_loadimage(vm, job->image->file,
+			job->image->size, options)) == SYRECI_OK) {
+	    syreci_output(vm, collect, job, false);
+	    job->status = syreci_run(vm, 0);
+	    if (job->status == SYRECI_OVERFLOW ||
+		job->status == SYRECI_DIVIDE)
+		collect(job, buf, snprintf(buf, sizeof(buf),
+			"%s, PC=%d, execution aborted\n",
+			syreci_message(job->status), (int)syreci_pc(vm)));
+	} else
+	    job->error = strdup(syreci_error(vm));
+	job->latency = now() - start;
+	if (job->fp) {
+	    fclose(job->fp);
+	    job->fp = 0;
+	}
+	pthread_mutex_lock(&donelock);
+	job->done = true;
+	pthread_cond_broadcast(&doneflag);
+	pthread_mutex_unlock(&donelock);
+    }
+    syreci_destroy(vm);
+    return 0;
+}
+
+static int compare(const void *p, const void *q)
+{
+    double x = *(double *)p, y = *(double *)q;
+
+    return x < y ? -1 : x > y;
+}
+
+static int byname(const void *p, const void *q)
+{
+    return strcmp(*(char **)p, *(char **)q);
+}
+
+static int bybase(const void *p, const void *q)
+{
+    const outname_t *x = p, *y = q;
+    int c = strcmp(x->base, y->base);
+
+    return c ? c : x->job - y->job;
+}
+
+/*
+    listdir adds the regular files in directory dir to names, sorted.
+*/
+static char **listdir(char *dir, char **names, int *count, int *max)
+{
+    DIR *dp;
+    struct dirent *entry;
+    struct stat buf;
+    char *name;
+    int first = *count;
+
+    if ((dp = opendir(dir)) == 0)
+	return names;
+    while ((entry = readdir(dp)) != 0) {
+	name = malloc(strlen(dir) + strlen(entry->d_name) + 2);
+	sprintf(name, "%s/%s", dir, entry->d_name);
+	if (stat(name, &buf) || !S_ISREG(buf.st_mode)) {
+	    free(name);
+	    continue;
+	}
+	if (*count == *max)
+	    names = realloc(names, (*max *= 2) * sizeof(char *));
+	names[(*count)++] = name;
+    }
+    closedir(dp);
+    qsort(names + first, *count - first, sizeof(char *), byname);
+    return names;
+}
+
+/*
+    mapimage maps file name once, or compiles it when it is a source file;
+    the images are kept in the order of their names.
+*/
+static image_t *mapimage(char *name, image_t *images, int count)
+{
+    FILE *fp;
+    size_t size = strlen(name);
+    image_t *image;
+    int lo = 0, hi = count;
+
+    while (lo < hi)
+	if (strcmp(images[(lo + hi) / 2].name, name) < 0)
+	    lo = (lo + hi) / 2 + 1;
+	else
+	    hi = (lo + hi) / 2;
+    image = &images[lo];
+    if (image->file)
+	return image;
+    if (size > 4 && !strcmp(name + size - 4, ".inp")) {
+	if ((fp = fopen(name, "r")) == 0 || translate(fp) ||
+	    (image->file = assemble(&image->size, 1)) == 0)
+	    fprintf(stderr, "%s (cannot compile)\n", name);
+	else
+	    image->compiled = true;
+	if (fp)
+	    fclose(fp);
+    } else if ((image->file = syreci_map(name, &image->size)) == 0)
+	fprintf(stderr, "%s (%s)\n", name, syreci_message(SYRECI_NOFILE));
+    return image;
+}
+
+/*
+    openout opens the output file in dir of each job that can run, named
+    after the base name of its file. The jobs after the first with the same
+    base name, by a repeated file or by files in other directories, write to
+    base.2.out, base.3.out and so on.
+*/
+static void openout(char *dir, char **names, int count)
+{
+    int i, k, copy = 0;
+    outname_t *outs;
+    char *path;
+
+    outs = malloc(count * sizeof(outname_t));
+    for (i = 0; i < count; i++) {
+	outs[i].base = strrchr(names[i], '/') ? strrchr(names[i], '/') + 1 :
+		       names[i];
+	outs[i].job = i;
+    }
+    qsort(outs, count, sizeof(outname_t), bybase);
+    for (i = 0; i < count; i++) {
+	copy = i && !strcmp(outs[i - 1].base, outs[i].base) ? copy + 1 : 1;
+	if (jobs[outs[i].job].skipped)
+	    continue;
+	k = strlen(dir) + strlen(outs[i].base) + 20;
+	path = malloc(k);
+	if (copy == 1)
+	    snprintf(path, k, "%s/%s.out", dir, outs[i].base);
+	else
+	    snprintf(path, k, "%s/%s.%d.out", dir, outs[i].base, copy);
+	if ((jobs[outs[i].job].fp = fopen(path, "w")) == 0) {
+	    fprintf(stderr, "%s (cannot create)\n", path);
+	    jobs[outs[i].job].skipped = jobs[outs[i].job].done = true;
+	}
+	free(path);
+    }
+    free(outs);
+}
+
+int batch(int argc, char *argv[], int opts)
+{
+    int i, k, count = 0, imagecount, max = 16, threads = 0, started,
+	rv = EXIT_SUCCESS;
+    char **names, *dir = 0;
+    image_t *images;
+    struct stat buf;
+    double start, seconds, *latency;
+
+    options = opts;
+    for (; argc > 1 && argv[1][0] == '-' && argv[1][1]; argc--, argv++)
+	if (!strcmp(argv[1], "-j"))
+	    options |= SYRECI_JIT;
+	else if (!strcmp(argv[1], "-t") && argc > 2 &&
+		 (threads = atoi(argv[2])) > 0)
+	    argc--, argv++;
+	else if (!strcmp(argv[1], "-o") && argc > 2)
+	    dir = argv[2], argc--, argv++;
+	else
+	    argc = 0;
+    if (argc < 2) {
+	fprintf(stderr, "usage: 32syreci -b [-j] [-t threads] [-o dir] "
+		"file... | dir\n");
+	return EXIT_FAILURE;
+    }
+    names = malloc(max * sizeof(char *));
+    for (i = 1; i < argc; i++)
+	if (!stat(argv[i], &buf) && S_ISDIR(buf.st_mode))
+	    names = listdir(argv[i], names, &count, &max);
+	else {
+	    if (count == max)
+		names = realloc(names, (max *= 2) * sizeof(char *));
+	    names[count++] = strdup(argv[i]);
+	}
+    if (!count) {
+	free(names);
+	return EXIT_SUCCESS;
+    }
+    images = calloc(count, sizeof(image_t));
+    for (i = 0; i < count; i++)
+	images[i].name = names[i];
+    qsort(images, count, sizeof(image_t), byname);
+    for (i = imagecount = 0; i < count; i++)
+	if (!imagecount ||
+	    strcmp(images[imagecount - 1].name, images[i].name))
+	    images[imagecount++] = images[i];
+    jobs = calloc(count, sizeof(job_t));
+    for (i = 0; i < count; i++) {
+	jobs[i].image = mapimage(names[i], images, imagecount);
+	if (!jobs[i].image->file)
+	    jobs[i].skipped = jobs[i].done = true;
+    }
+    if (dir)
+	openout(dir, names, count);
+    if (!threads)
+	threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1)
+	threads = 1;
+    if (threads > count)
+	threads = count;
+    workercount = threads;
+    workers = calloc(threads, sizeof(worker_t));
+    for (i = 0; i < threads; i++) {
+	pthread_mutex_init(&workers[i].lock, 0);
+	workers[i].jobs = malloc((count / threads + 1) * sizeof(uint32_t));
+    }
+    for (i = 0; i < count; i++)
+	if (!jobs[i].done)
+	    workers[i % threads].jobs[workers[i % threads].last++] = i;
+    start = now();
+    for (i = started = 0; i < threads; i++)
+	if (!pthread_create(&workers[i].thread, 0, work, (void *)(intptr_t)i))
+	    workers[i].started = true, started++;
+    /*
+	Without a thread at all, the jobs are run here; the output loop
+	below then finds them done.
+    */
+    if (!started) {
+	fprintf(stderr, "32syreci -b (cannot start threads)\n");
+	work(0);
+    }
+    /*
+	The output of each job is written when it and the jobs before it
+	are done.
+    */
+    for (i = 0; i < count; i++) {
+	pthread_mutex_lock(&donelock);
+	while (!jobs[i].done)
+	    pthread_cond_wait(&doneflag, &donelock);
+	pthread_mutex_unlock(&donelock);
+	fwrite(jobs[i].out, 1, jobs[i].outlen, stdout);
+	free(jobs[i].out);
+	jobs[i].out = 0;
+	if (jobs[i].status == SYRECI_HALT)
+	    continue;
+	rv = EXIT_FAILURE;
+	if (jobs[i].skipped)
+	    continue;
+	if (jobs[i].status != SYRECI_OVERFLOW &&
+	    jobs[i].status != SYRECI_DIVIDE)
+	    fprintf(stderr, "%s (%s)\n", names[i], jobs[i].error ?
+		    jobs[i].error : syreci_message(jobs[i].status));
+	free(jobs[i].error);
+    }
+    fflush(stdout);
+    for (i = 0; i < threads; i++)
+	if (workers[i].started)
+	    pthread_join(workers[i].thread, 0);
+    seconds = now() - start;
+    latency = calloc(count, sizeof(double));
+    for (i = k = 0; i < count; i++)
+	if (!jobs[i].skipped)
+	    latency[k++] = jobs[i].latency * 1000;
+    qsort(latency, k, sizeof(double), compare);
+    fprintf(stderr, "%12s%12s%12s%12s\n", "jobs", "threads", "seconds",
+	    "jobs/s");
+    fprintf(stderr, "%12d%12d%12.3f%12.0f\n", count, started ? started : 1,
+	    seconds, seconds > 0 ? count / seconds : 0);
+    if (k) {
+	fprintf(stderr, "%12s%12s%12s%12s%12s\n", "latency ms", "p50", "p90",
+		"p99", "max");
+	fprintf(stderr, "%12s%12.3f%12.3f%12.3f%12.3f\n", "", latency[k / 2],
+		latency[k * 9 / 10], latency[k * 99 / 100], latency[k - 1]);
+    }
+    free(latency);
+    for (i = 0; i < threads; i++) {
+	pthread_mutex_destroy(&workers[i].lock);
+	free(workers[i].jobs);
+    }
+    free(workers);
+    for (i = 0; i < imagecount; i++)
+	if (images[i].compiled)
+	    free(images[i].file);
+	else if (images[i].file)
+	    syreci_unmap(images[i].file, images[i].size);
+    free(images);
+    free(jobs);
+    for (i = 0; i < count; i++)
+	free(names[i]);
+    free(names);
+    return rv;
+}
+#else
+int batch(int argc, char *argv[], int opts)
+{
+    fprintf(stderr, "32syreci -b is not available\n");
+    return EXIT_FAILURE;
+}
+#endif
@@ -0,0 +1,59 @@
+#!/bin/sh
+#
+#   module  : bench.sh
+#   version : 1.2
+#   date    : 10/17/26
+#
+#   Runs the benchmarks and appends the results to a CSV file: the wall time
+#   of 32syreci, with and without -j, with the number of instructions executed
+#   and instructions per second, and the speed of 32syrecc in lines per second.
+#   Run from the top directory, after make; CSV names the file.
+#
+CSV=${CSV:-bench/results.csv}
+TMP=${TMPDIR:-/tmp}/bench.$$
+PROCS=${PROCS:-2000}
+LINES=${LINES:-100000}
+
+mkdir -p $TMP
+trap 'rm -rf $TMP' 0
+date=$(date +%Y-%m-%dT%H:%M:%S)
+commit=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+[ -f $CSV ] ||
+    echo "date,commit,benchmark,program,seconds,count,unit,per_second" >$CSV
+
+# now prints the time of day in seconds, to the microsecond; date +%N is
+# not portable
+now() {
+    perl -MTime::HiRes=time -e 'printf "%.6f\n", time'
+}
+
+# seconds runs a command and prints its wall time in seconds
+seconds() {
+    start=$(now)
+    "$@" >/dev/null || echo "$* failed" >&2
+    end=$(now)
+    awk "BEGIN { printf \"%.3f\", $end - $start }"
+}
+
+# record benchmark program unit seconds count
+record() {
+    rate=$(awk "BEGIN { printf \"%.0f\", ($4 > 0 ? $5 / $4 : 0) }")
+    echo "$date,$commit,$1,$2,$4,$5,$3,$rate" >>$CSV
+    printf "%-10s %-14s %8.3f s %12s %s/s\n" $1 "$2" $4 $rate $3
+}
+
+bench/gen procs $PROCS >$TMP/procs.inp
+bench/gen lines $LINES >$TMP/lines.inp
+for src in bench/*.inp $TMP/procs.inp; do
+    name=$(basename $src .inp)
+    ./32syrecc -o $TMP/$name.bin $src
+    count=$(./32syreci -p $TMP/$name.bin 2>&1 >/dev/null |
+	    awk '$2 == "total" { print $1 }')
+    record $name 32syreci instructions $(seconds ./32syreci $TMP/$name.bin) \
+	   $count
+    record $name "32syreci -j" instructions \
+	   $(seconds ./32syreci -j $TMP/$name.bin) $count
+done
+count=$(wc -l <$TMP/lines.inp)
+record lines 32syrecc lines \
+       $(seconds ./32syrecc -o $TMP/lines.bin $TMP/lines.inp) $count
@@ -0,0 +1,73 @@
+/*
+    module  : gen.c
+    version : 1.1
+    date    : 10/17/26
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAXGLB	20
+
+/*
+    procs writes a program with n procedures, that main calls in a loop. Every
+    odd procedure also calls the procedure before it.
+*/
+void procs(int n)
+{
+    int i;
+
+    printf("INTEGER x i\n");
+    for (i = 0; i < n; i++) {
+	printf("PROCEDURE p%d\nBEGIN\n", i);
+	printf("    x := x + %d MOD 7 * (x MOD 13);\n", i);
+	printf("    IF x > 1000000 THEN x := x - 1000000 ENDIF");
+	if (i % 2)
+	    printf(";\n    p%d", i - 1);
+	printf("\nEND\n");
+    }
+    printf("BEGIN\n    x := 1;\n    i := 0;\n    WHILE i < %d DO\n",
+	   1000000 / n + 1);
+    for (i = 0; i < n; i++)
+	printf("\tp%d;\n", i);
+    printf("\ti := i + 1\n    ENDWHILE;\n    WRITE x\nEND .\n");
+}
+
+/*
+    lines writes a program of n lines of straight line code and conditions
+    over MAXGLB globals, to measure the speed of the compiler.
+*/
+void lines(int n)
+{
+    int i;
+
+    printf("INTEGER");
+    for (i = 0; i < MAXGLB; i++)
+	printf(" g%d", i);
+    printf("\nBOOLEAN flag\nBEGIN\n    flag := FALSE;\n");
+    for (i = 0; i < n; i++)
+	if (i % 10 == 9)
+	    printf("    IF g%d < g%d OR flag THEN flag := NOT flag ENDIF;\n",
+		   i % MAXGLB, (i * 7 + 3) % MAXGLB);
+	else
+	    printf("    g%d := g%d + g%d * %d - (g%d MOD %d);\n", i % MAXGLB,
+		   (i * 3 + 1) % MAXGLB, (i * 5 + 2) % MAXGLB, i % 97,
+		   (i * 11 + 4) % MAXGLB, i % 89 + 1);
+    printf("    WRITE g0\nEND .\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int n;
+
+    if (argc != 3 || (n = atoi(argv[2])) < 1 ||
+	(strcmp(argv[1], "procs") && strcmp(argv[1], "lines"))) {
+	fprintf(stderr, "usage: gen procs|lines count\n");
+	exit(EXIT_FAILURE);
+    }
+    if (!strcmp(argv[1], "procs"))
+	procs(n);
+    else
+	lines(n);
+    exit(EXIT_SUCCESS);
+}
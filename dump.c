@@ -1,7 +1,7 @@
 /*
     module  : dump.c
-    version : 1.4
-    date    : 08/17/23
+    version : 1.8
+    date    : 10/17/26
 */
 #include <stdio.h>
 #include <string.h>
@@ -10,36 +10,83 @@
 #include "32syreci.h"
 
 #define MAXSTR	80
-#define INSCNT	25
+#define INSCNT	(int)(sizeof(operator_NAMES) / sizeof(operator_NAMES[0]))
 
 /*
     instruction, adr1, adr2;
+
+    The instructions are collected first, because the header that precedes them
+    contains their number. A LOADIMMED of a constant that does not fit in adr2
+    becomes a LOADCONST of a constant in the pool. An instruction that cannot be
+    packed would shift all that follow, so then no file is written, and an
+    older one is removed.
 */
 int main(int argc, char *argv[])
 {
-    int i;
+    int i, rv = EXIT_SUCCESS;
     FILE *fp;
-    int64_t l;
-    instruction ins;
+    int64_t l, adr1, adr2, *pool;
+    header hdr;
+    instruction *code;
+    uint32_t codemax = 256, poolmax = 16;
     char str[MAXSTR], *filename;
 
-    filename = argc == 2 ? argv[1] : inputfile;
-    if ((fp = fopen(filename, "wb")) == 0) {
-	fprintf(stderr, "%s (cannot create)\n", filename);
+    if (argc > 2 || (argc == 2 && argv[1][0] == '-')) {
+	fprintf(stderr, "usage: dump [bytecode] <listing\n");
 	exit(EXIT_FAILURE);
     }
+    filename = argc == 2 ? argv[1] : inputfile;
+    memcpy(hdr.magic, MAGIC, sizeof(hdr.magic));
+    hdr.version = VERSION;
+    hdr.codesize = 1;
+    hdr.poolsize = 0;
+    code = malloc(codemax * sizeof(instruction));
+    pool = malloc(poolmax * sizeof(int64_t));
+    code[0].op = hlt;
+    code[0].adr1 = code[0].adr2 = 0;
     while (scanf("%" SCNd64 "%s %" SCNd64 "%" SCNd64,
-		&l, str, &ins.adr1, &ins.adr2) == 4) {
+		&l, str, &adr1, &adr2) == 4) {
 	for (i = 0; i < INSCNT; i++)
 	    if (!strcmp(str, operator_NAMES[i]))
 		break;
-	if (i == INSCNT)
+	if (i == INSCNT) {
 	    fprintf(stderr, "%s not found\n", str);
-	else {
-	    ins.op = i;
-	    fwrite(&ins, sizeof(ins), 1, fp);
+	    rv = EXIT_FAILURE;
+	    continue;
+	}
+	if (i == loadimmed && !SHORT(adr2)) {
+	    if (hdr.poolsize == poolmax)
+		pool = realloc(pool, (poolmax *= 2) * sizeof(int64_t));
+	    pool[hdr.poolsize] = adr2;
+	    adr2 = hdr.poolsize++;
+	    i = loadconst;
 	}
+	if (adr1 < 0 || adr1 > MAXADR1 || !SHORT(adr2)) {
+	    fprintf(stderr, "%" PRId64 " %s (operand out of range)\n", l, str);
+	    rv = EXIT_FAILURE;
+	    continue;
+	}
+	if (hdr.codesize == codemax)
+	    code = realloc(code, (codemax *= 2) * sizeof(instruction));
+	code[hdr.codesize].op = i;
+	code[hdr.codesize].adr1 = adr1;
+	code[hdr.codesize++].adr2 = adr2;
+    }
+    if (rv == EXIT_FAILURE) {
+	remove(filename);
+	exit(rv);
+    }
+    if ((fp = fopen(filename, "wb")) == 0) {
+	fprintf(stderr, "%s (cannot create)\n", filename);
+	exit(EXIT_FAILURE);
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	fwrite(code, sizeof(instruction), hdr.codesize, fp) != hdr.codesize ||
+	fwrite(pool, sizeof(int64_t), hdr.poolsize, fp) != hdr.poolsize ||
+	fclose(fp)) {
+	fprintf(stderr, "%s (cannot create)\n", filename);
+	remove(filename);
+	exit(EXIT_FAILURE);
     }
-    fclose(fp);
-    exit(EXIT_SUCCESS);
+    exit(rv);
 }
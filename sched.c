@@ -0,0 +1,189 @@
+/*
+    module  : sched.c
+    version : 1.2
+    date    : 10/17/26
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <time.h>
+#include "32syreci.h"
+#include "syreci.h"
+
+/*
+    32syreci -m runs many programs at the same time on one thread. Each
+    program has a machine of its own, that runs for a quantum of instructions
+    at a time, its slice, and is then put back in line. The programs are
+    scheduled by stride: a program with priority p advances its pass by
+    stride / p for each slice, and the program with the lowest pass runs
+    next, so that it gets slices in proportion to its priority. The output of
+    the programs is interleaved at the end of each slice. The instructions,
+    the slices and the time of each program are printed to stderr.
+*/
+#define STRIDE		(1 << 20)
+#define QUANTUM		10000
+
+typedef struct task_t {
+    char *name;
+    syreci *vm;
+    int priority;
+    uint64_t pass;		/* the virtual time of the task */
+    int64_t slices;
+    double seconds;
+    syreci_status status;
+} task_t;
+
+static task_t *tasks;
+static int *heap, heapsize;	/* the runnable tasks, lowest pass first */
+
+static bool before(int i, int j)
+{
+    return tasks[i].pass < tasks[j].pass ||
+	   (tasks[i].pass == tasks[j].pass && i < j);
+}
+
+static void push(int t)
+{
+    int i, parent;
+
+    for (i = heapsize++; i > 0; i = parent) {
+	parent = (i - 1) / 2;
+	if (!before(t, heap[parent]))
+	    break;
+	heap[i] = heap[parent];
+    }
+    heap[i] = t;
+}
+
+static int pop(void)
+{
+    int i, child, t = heap[0], last = heap[--heapsize];
+
+    for (i = 0; (child = 2 * i + 1) < heapsize; i = child) {
+	if (child + 1 < heapsize && before(heap[child + 1], heap[child]))
+	    child++;
+	if (!before(heap[child], last))
+	    break;
+	heap[i] = heap[child];
+    }
+    heap[i] = last;
+    return t;
+}
+
+static void emit(void *context, const char *buf, size_t size)
+{
+    fwrite(buf, 1, size, stdout);
+}
+
+/*
+    load loads file name, name[:priority], in the machine of task, and
+    compiles it first when it is a source file. Only digits after the last
+    colon are a priority; otherwise the colon is part of the name.
+*/
+static bool load(task_t *task, char *name, int options)
+{
+    FILE *fp;
+    char *colon, *file;
+    size_t size;
+
+    if ((colon = strrchr(name, ':')) != 0 && colon[1] &&
+	strspn(colon + 1, "0123456789") == strlen(colon + 1)) {
+	*colon = 0;
+	if ((task->priority = atoi(colon + 1)) < 1)
+	    task->priority = 1;
+    }
+    task->name = name;
+    if ((task->vm = syreci_create()) == 0) {
+	fprintf(stderr, "%s (%s)\n", name, syreci_message(SYRECI_MEMORY));
+	return false;
+    }
+    syreci_output(task->vm, emit, 0, false);
+    size = strlen(name);
+    if (size > 4 && !strcmp(name + size - 4, ".inp")) {
+	if ((fp = fopen(name, "r")) == 0 || translate(fp) ||
+	    (file = assemble(&size, 1)) == 0) {
+	    fprintf(stderr, "%s (cannot compile)\n", name);
+	    if (fp)
+		fclose(fp);
+	    return false;
+	}
+	fclose(fp);
+	task->status = syreci_loadbuffer(task->vm, file, size, options);
+	free(file);
+    } else
+	task->status = syreci_load(task->vm, name, options);
+    if (task->status != SYRECI_OK) {
+	fprintf(stderr, "%s (%s)\n", name, syreci_error(task->vm));
+	return false;
+    }
+    return true;
+}
+
+int schedule(int argc, char *argv[], int options)
+{
+    int i, t, count, rv = EXIT_SUCCESS;
+    int64_t quantum = QUANTUM, executed, total = 0, slices = 0;
+    double seconds = 0;
+    clock_t start;
+    task_t *task;
+
+    for (; argc > 1 && argv[1][0] == '-' && argv[1][1]; argc--, argv++)
+	if (!strcmp(argv[1], "-q") && argc > 2 &&
+	    (quantum = atoll(argv[2])) > 0)
+	    argc--, argv++;
+	else
+	    argc = 0;
+    if (argc < 2) {
+	fprintf(stderr, "usage: 32syreci -m [-q quantum] "
+		"file[:priority]...\n");
+	return EXIT_FAILURE;
+    }
+    count = argc - 1;
+    tasks = calloc(count, sizeof(task_t));
+    heap = malloc(count * sizeof(int));
+    for (i = 0; i < count; i++) {
+	tasks[i].priority = 1;
+	if (load(&tasks[i], argv[i + 1], options))
+	    push(i);
+	else
+	    rv = EXIT_FAILURE;
+    }
+    while (heapsize) {
+	task = &tasks[t = pop()];
+	start = clock();
+	task->status = syreci_run(task->vm, quantum);
+	task->seconds += (double)(clock() - start) / CLOCKS_PER_SEC;
+	task->slices++;
+	if (task->status == SYRECI_BUDGET) {
+	    task->pass += STRIDE / task->priority;
+	    push(t);
+	    continue;
+	}
+	if (task->status != SYRECI_HALT) {
+	    printf("%s: %s, PC=%d, execution aborted\n", task->name,
+		   syreci_message(task->status), (int)syreci_pc(task->vm));
+	    rv = EXIT_FAILURE;
+	}
+    }
+    fflush(stdout);
+    fprintf(stderr, "%14s%10s%10s%10s  %s\n", "instructions", "slices",
+	    "seconds", "priority", "program");
+    for (i = 0; i < count; i++) {
+	task = &tasks[i];
+	executed = task->vm ? syreci_executed(task->vm) : 0;
+	fprintf(stderr, "%14" PRId64 "%10" PRId64 "%10.3f%10d  %s\n",
+		executed, task->slices, task->seconds, task->priority,
+		task->name);
+	total += executed;
+	slices += task->slices;
+	seconds += task->seconds;
+	syreci_destroy(task->vm);
+    }
+    fprintf(stderr, "%14" PRId64 "%10" PRId64 "%10.3f%10s  %s\n", total,
+	    slices, seconds, "", "total");
+    free(heap);
+    free(tasks);
+    return rv;
+}
@@ -0,0 +1,2843 @@
+/*
+    module  : syreci.c
+    version : 1.4
+    date    : 10/17/26
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <signal.h>
+#endif
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#include "32syreci.h"
+#include "syreci.h"
+
+/* SYmboltable, RECursion, Interpreter only,
+   interprets a file of instructions produced by syrecc */
+
+#define showcode false
+#define tracing false
+/* pairstats counts pairs of opcodes; build with -Dpairstats=true */
+#ifndef pairstats
+#define pairstats false
+#endif
+
+#define maxstack 1000
+#define topregister 7
+
+/*
+    number of instructions or lines in the hot spot reports of the profilers,
+    and the interval of the sampling profiler in microseconds.
+*/
+#define maxhot 20
+#define interval 1000
+
+/*
+    number of hardware counters that -e reads.
+*/
+#define maxevent 4
+
+/*
+    largest size of the output buffer. WRITEINT and WRITEBOOL fill the buffer,
+    that is passed to the writer when it is full, when the machine stops, and
+    on every line when eachline is set. The buffer starts as the line in the
+    machine, and grows from outfirst bytes as the program writes, so that a
+    machine that writes little, as under -m, stays small.
+*/
+#define outsize 65536
+#define outfirst 256
+#define outline 32
+
+/*
+    With SYRECI_MEMO the results of the calls of pure procedures are kept in a
+    cache of memosize entries, each for one key. A procedure with more than
+    maxkey variables in its key is not cached. A call that misses is pending
+    until it returns; its entry is then filled with the variables that the
+    procedure writes.
+*/
+#define memosize 4096
+#define maxkey 16
+#define maxpending (maxstack / 2 + 1)
+
+typedef struct memo_t {
+    uint32_t entry, keys, writes,
+	*var;			/* the key, followed by the writes */
+    int64_t hits, misses;
+} memo_t;
+
+typedef struct pending_t {
+    uint32_t memo, slot;
+    int64_t base, key[maxkey];
+} pending_t;
+
+/*
+    threaded selects computed goto dispatch, available in GCC and Clang. The
+    loaded instructions are translated once into threaded code, where the
+    opcode is replaced by the address of its handler. Other compilers use the
+    switch statement and execute the loaded instructions.
+*/
+#if defined(__GNUC__) && !tracing && !pairstats
+#define threaded true
+#define CASE(x)	do_##x
+#define NEXT	goto *pc->label
+
+typedef struct code_t {
+    void *label;
+    int32_t adr1, adr2;
+} code_t;
+#else
+#define threaded false
+#define CASE(x)	case x
+#define NEXT	continue
+
+typedef instruction code_t;
+#endif
+
+/*
+    jitted selects the JIT, on x86-64. The native code is called with the
+    machine and its stack, and returns the index of the instruction where it
+    stopped: a halt, or an instruction that failed.
+*/
+#if defined(__x86_64__) && !defined(_WIN32)
+#define jitted true
+
+typedef uint32_t (*native_t)(syreci *vm, int64_t *stack);
+#else
+#define jitted false
+#endif
+
+#define maxoper (sizeof(operator_NAMES) / sizeof(operator_NAMES[0]))
+
+/*
+    ZEROONE is true for a divisor of 0, that fails, and of -1, that is done
+    without division because INT64_MIN / -1 traps.
+*/
+#define ZEROONE(x)	((uint64_t)(x) + 1 <= 1)
+
+/*
+    WRAP does the arithmetic of the machine modulo 2^64, as the JIT and the C
+    translation do; signed overflow is undefined in C.
+*/
+#define WRAP(x, op, y)	((int64_t)((uint64_t)(x) op (uint64_t)(y)))
+
+/*
+    A snapshot file holds the state of a machine: a header, followed by the
+    stack up to and including stacktop. hash identifies the program, that
+    must be loaded in the machine that restores the snapshot.
+*/
+#define SNAPMAGIC	"SNAP"
+
+typedef struct snapshot {
+    char magic[4];
+    uint32_t version,
+	pc,
+	status;
+    uint64_t hash;
+    int64_t executed, stacktop, baseregister, reg[topregister + 1];
+} snapshot;
+
+#define STRING(x)	#x
+#define VALUE(x)	STRING(x)
+
+struct syreci {
+    char *file;			/* the bytecode file */
+    size_t size;
+    bool mapped,		/* file is from syreci_map */
+	borrowed;		/* file belongs to the caller */
+    int options;
+    header *hdr;
+    instruction *image;
+    int64_t *pool;
+    linetable *lines;
+    puretable *pure;
+    bool *trusted;		/* the pure procedures that verify accepts */
+    code_t *code;		/* translated at the first run */
+    bool translated,		/* code is filled in */
+	ticked,			/* the leaders of code go to tick */
+	started,		/* the program has run */
+	stopped;		/* the program halted or failed */
+    syreci_status status;	/* why the program stopped */
+    void **handlers,		/* handlers behind the stubs of the profilers */
+	**stubs;		/* handlers behind tick */
+    bool *leader;
+    int64_t *blocks;		/* the length of the basic block of a leader */
+#if jitted
+    native_t native;
+    size_t nativesize;
+    unsigned char **table;
+#endif
+    int64_t *counts, *samples;
+    memo_t *memos;
+    uint32_t nmemos,
+	*memoof;		/* 1 + the memo that starts here */
+    int64_t *cache;		/* memosize entries: 1 + memo, key, writes */
+    pending_t *pending;
+    int npending;
+    uint64_t *perproc, lastevent[maxevent];
+    uint32_t *procstack;	/* maxstack + 1 procedures, with -e */
+    int proctop;
+    syreci_writer writer;
+    void *context;
+    bool eachline;
+    char *outbuf;		/* line, or up to outsize bytes */
+    int outlen, outlimit, outmax;
+    uint32_t pc;
+    int64_t maxdepth;		/* of the stack, or -1 when recursive */
+    char diagnostic[96];	/* why the last load failed */
+    int64_t executed;		/* instructions charged to budgets */
+    int64_t stacktop, baseregister, reg[topregister + 1], *stack;
+    char line[outline];
+};
+
+/*
+    THREADLOCAL declares a variable of which each thread has its own copy.
+*/
+#ifdef _MSC_VER
+#define THREADLOCAL __declspec(thread)
+#else
+#define THREADLOCAL _Thread_local
+#endif
+
+/*
+    The stacks of the machines come from a pool: a list of free stacks in
+    each thread, that is filled a chunk of stacks at a time. A stack that
+    is freed in another thread joins the list of that thread.
+*/
+#define chunksize 64
+
+typedef union stackblock {
+    union stackblock *next;
+    int64_t slot[maxstack + 1];
+} stackblock;
+
+static THREADLOCAL stackblock *freestacks;
+
+/*
+    pairs counts how often an instruction is followed by another instruction.
+*/
+static int64_t pairs[maxoper][maxoper];
+
+/*
+    The sampling profiler keeps the instruction that is executing in current;
+    SIGPROF counts that instruction in samples.
+*/
+static code_t *volatile current, *codebase;
+static int64_t *samples;
+
+/*
+    digits holds the decimal representation of 0 .. 99, two characters each.
+*/
+static const char digits[] =
+    "000102030405060708091011121314151617181920212223242526272829"
+    "303132333435363738394041424344454647484950515253545556575859"
+    "606162636465666768697071727374757677787980818283848586878889"
+    "90919293949596979899";
+
+/*
+    flush passes the output buffer to the writer, or writes it to stdout.
+*/
+static void flush(syreci *vm)
+{
+    if (!vm->outlen)
+	return;
+    if (vm->writer)
+	vm->writer(vm->context, vm->outbuf, vm->outlen);
+    else {
+	fwrite(vm->outbuf, 1, vm->outlen, stdout);
+	fflush(stdout);
+    }
+    vm->outlen = 0;
+}
+
+/*
+    outfull is called when the output passes outlimit: the buffer grows to
+    twice its size, up to outsize, and is flushed when it cannot grow or
+    eachline is set. At least outline bytes remain free.
+*/
+static void outfull(syreci *vm)
+{
+    char *buf;
+    int size = vm->outbuf == vm->line ? outfirst : 2 * vm->outmax;
+
+    if (vm->eachline || size > outsize ||
+	(buf = vm->outbuf == vm->line ? malloc(size) :
+	 realloc(vm->outbuf, size)) == 0) {
+	flush(vm);
+	return;
+    }
+    if (vm->outbuf == vm->line)
+	memcpy(buf, vm->line, vm->outlen);
+    vm->outbuf = buf;
+    vm->outmax = size;
+    vm->outlimit = size - outline;
+}
+
+/*
+    putint formats x as printf("%12" PRId64 "\n") would, two digits at a time
+    from the right.
+*/
+static void putint(syreci *vm, int64_t x)
+{
+    char str[24], *ptr = str + sizeof(str);
+    uint64_t u = x < 0 ? -(uint64_t)x : (uint64_t)x;
+
+    *--ptr = '\n';
+    for (; u >= 100; u /= 100) {
+	ptr -= 2;
+	memcpy(ptr, &digits[u % 100 * 2], 2);
+    }
+    if (u >= 10) {
+	ptr -= 2;
+	memcpy(ptr, &digits[u * 2], 2);
+    } else
+	*--ptr = '0' + u;
+    if (x < 0)
+	*--ptr = '-';
+    while (ptr > str + sizeof(str) - 13)
+	*--ptr = ' ';
+    memcpy(&vm->outbuf[vm->outlen], ptr, str + sizeof(str) - ptr);
+    if ((vm->outlen += str + sizeof(str) - ptr) > vm->outlimit)
+	outfull(vm);
+}
+
+static void putbool(syreci *vm, int64_t x)
+{
+    if (x == 1) {
+	memcpy(&vm->outbuf[vm->outlen], "TRUE\n", 5);
+	vm->outlen += 5;
+    } else {
+	memcpy(&vm->outbuf[vm->outlen], "FALSE\n", 6);
+	vm->outlen += 6;
+    }
+    if (vm->outlen > vm->outlimit)
+	outfull(vm);
+}
+
+static void debug(syreci *vm, instruction *pc, instruction *code)
+{
+    flush(vm);
+    printf("%12d%12.12s%12d%12d\n", (int)(pc - code),
+	operator_NAMES[pc->op], pc->adr1, pc->adr2);
+}
+
+/*
+    load maps a bytecode file in memory, read-only, so that the pages can be
+    shared with other processes. Where mmap is not available, the file is read
+    in one call. The size of the file is returned in size.
+*/
+static char *load(const char *filename, size_t *size)
+{
+    char *file;
+#ifdef _WIN32
+    FILE *fp;
+    long length;
+
+    if ((fp = fopen(filename, "rb")) == NULL)
+	return 0;
+    fseek(fp, 0, SEEK_END);
+    length = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (length < (long)sizeof(header) || (file = malloc(length)) == 0 ||
+	fread(file, 1, length, fp) != (size_t)length) {
+	fclose(fp);
+	return 0;
+    }
+    fclose(fp);
+    *size = length;
+#else
+    int fd;
+    struct stat buf;
+
+    if ((fd = open(filename, O_RDONLY)) == -1)
+	return 0;
+    if (fstat(fd, &buf) || buf.st_size < (off_t)sizeof(header)) {
+	close(fd);
+	return 0;
+    }
+    file = mmap(0, buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED)
+	return 0;
+    *size = buf.st_size;
+#endif
+    return file;
+}
+
+static int compare(const void *p, const void *q)
+{
+    int64_t x = **(int64_t **)p, y = **(int64_t **)q;
+
+    if (x != y)
+	return x < y ? 1 : -1;
+    return *(int64_t **)p < *(int64_t **)q ? -1 : 1;	/* keep order */
+}
+
+/*
+    report prints the pairs of instructions that were executed, the most
+    frequent pairs first. They are candidates for superinstructions.
+*/
+static void report(FILE *fp)
+{
+    int i, j, k;
+    int64_t *list[maxoper * maxoper];
+
+    for (i = k = 0; i < (int)maxoper; i++)
+	for (j = 0; j < (int)maxoper; j++)
+	    if (pairs[i][j])
+		list[k++] = &pairs[i][j];
+    qsort(list, k, sizeof(int64_t *), compare);
+    for (i = 0; i < k; i++) {
+	j = list[i] - &pairs[0][0];
+	fprintf(fp, "%12" PRId64 "%12.12s%12.12s\n", *list[i],
+		operator_NAMES[j / maxoper], operator_NAMES[j % maxoper]);
+    }
+}
+
+/*
+    hotspots prints the profile collected with -p: how often each opcode,
+    instruction and procedure was executed, the most frequent first. The
+    procedures start at the targets of CAL; an instruction belongs to the
+    last procedure that starts at or before it.
+*/
+static void hotspots(instruction *image, uint32_t size, int64_t *counts,
+		     FILE *fp)
+{
+    uint32_t i, j, k, entry;
+    int64_t total = 0, ops[maxoper] = { 0 }, *calls, *inside, **list;
+
+    calls = calloc(size, sizeof(int64_t));
+    inside = calloc(size, sizeof(int64_t));
+    list = malloc((size > maxoper ? size : maxoper) * sizeof(int64_t *));
+    for (i = 1; i < size; i++) {
+	total += counts[i];
+	ops[image[i].op] += counts[i];
+	if (image[i].op == cal)
+	    calls[image[i].adr1] += counts[i];
+    }
+    fprintf(fp, "%12s%12s%8s\n", "count", "opcode", "%");
+    for (i = k = 0; i < maxoper; i++)
+	if (ops[i])
+	    list[k++] = &ops[i];
+    qsort(list, k, sizeof(int64_t *), compare);
+    for (i = 0; i < k; i++)
+	fprintf(fp, "%12" PRId64 "%12.12s%7.2f%%\n", *list[i],
+		operator_NAMES[list[i] - ops], 100.0 * *list[i] / total);
+    fprintf(fp, "%12" PRId64 "%12s\n", total, "total");
+    fprintf(fp, "\n%12s%12s%12s%12s%12s\n", "count", "index", "opcode",
+	    "adr1", "adr2");
+    for (i = k = 0; i < size; i++)
+	if (counts[i])
+	    list[k++] = &counts[i];
+    qsort(list, k, sizeof(int64_t *), compare);
+    for (i = 0; i < k && i < maxhot; i++) {
+	j = list[i] - counts;
+	fprintf(fp, "%12" PRId64 "%12u%12.12s%12d%12d\n", *list[i], j,
+		operator_NAMES[image[j].op], image[j].adr1, image[j].adr2);
+    }
+    fprintf(fp, "\n%12s%12s%8s%12s\n", "count", "calls", "%",
+	    "procedure");
+    for (entry = 0, i = 1; i < size; i++) {
+	if (calls[i])
+	    entry = i;
+	inside[entry] += counts[i];
+    }
+    for (i = k = 0; i < size; i++)
+	if (calls[i])
+	    list[k++] = &inside[i];
+    qsort(list, k, sizeof(int64_t *), compare);
+    for (i = 0; i < k; i++) {
+	j = list[i] - inside;
+	fprintf(fp, "%12" PRId64 "%12" PRId64 "%7.2f%%%12u\n", *list[i],
+		calls[j], 100.0 * *list[i] / total, j);
+    }
+    free(list);
+    free(inside);
+    free(calls);
+}
+
+/*
+    getlines returns the line table that follows the pool, or 0 if the rest of
+    the file is not a valid line table.
+*/
+static linetable *getlines(char *rest, size_t size, uint32_t codesize)
+{
+    uint32_t i;
+    linetable *table = (linetable *)rest;
+    procrange *range;
+    char *names;
+
+    if (size < sizeof(linetable) ||
+	memcmp(table->magic, LINEMAGIC, sizeof(table->magic)) ||
+	size != sizeof(linetable) + (size_t)codesize * sizeof(uint32_t) +
+	(size_t)table->procsize * sizeof(procrange) + table->namesize ||
+	!table->namesize)
+	return 0;
+    range = (procrange *)((uint32_t *)(table + 1) + codesize);
+    names = (char *)(range + table->procsize);
+    if (names[table->namesize - 1])
+	return 0;
+    for (i = 0; i < table->procsize; i++)
+	if (range[i].name >= table->namesize || range[i].first >= codesize ||
+	    (i && range[i].first <= range[i - 1].first))
+	    return 0;
+    return table;
+}
+
+/*
+    getpure returns the table of pure procedures at the start of the rest of
+    the file, and its size in length, or 0 if there is no valid table.
+*/
+static puretable *getpure(char *rest, size_t size, uint32_t codesize,
+			  size_t *length)
+{
+    uint32_t i, *var;
+    uint64_t vars = 0;
+    puretable *table = (puretable *)rest;
+    pureproc *proc;
+
+    if (size < sizeof(puretable) ||
+	memcmp(table->magic, PUREMAGIC, sizeof(table->magic)))
+	return 0;
+    *length = sizeof(puretable) + (size_t)table->procsize * sizeof(pureproc) +
+	      (size_t)table->varsize * sizeof(uint32_t);
+    if (size < *length)
+	return 0;
+    proc = (pureproc *)(table + 1);
+    var = (uint32_t *)(proc + table->procsize);
+    for (i = 0; i < table->procsize; i++) {
+	if (proc[i].entry == 0 || proc[i].entry >= codesize)
+	    return 0;
+	vars += (uint64_t)proc[i].keys + proc[i].writes;
+    }
+    if (vars != table->varsize)
+	return 0;
+    for (i = 0; i < table->varsize; i++)
+	if (var[i] > maxstack)
+	    return 0;
+    return table;
+}
+
+#ifndef _WIN32
+static void sample(int sig)
+{
+    code_t *pc = current;
+
+    if (pc)
+	samples[pc - codebase]++;
+}
+
+/*
+    startsampling counts the executing instruction every interval of
+    processor time.
+*/
+static void startsampling(void)
+{
+    struct sigaction action;
+    struct itimerval timer;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = sample;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, 0);
+    timer.it_interval.tv_sec = timer.it_value.tv_sec = 0;
+    timer.it_interval.tv_usec = timer.it_value.tv_usec = interval;
+    setitimer(ITIMER_PROF, &timer, 0);
+}
+
+static void stopsampling(void)
+{
+    struct itimerval timer;
+
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, 0);
+    current = 0;
+}
+#endif
+
+/*
+    lineprofile prints the samples per source line and per procedure, the
+    most frequent first.
+*/
+static void lineprofile(linetable *table, uint32_t size, int64_t *samples,
+			FILE *fp)
+{
+    uint32_t i, j, k, last = 0, *line = (uint32_t *)(table + 1);
+    int64_t total = 0, *perline, *perproc, **list;
+    procrange *range = (procrange *)(line + size);
+    char *names = (char *)(range + table->procsize);
+
+    for (i = 0; i < size; i++)
+	if (last < line[i])
+	    last = line[i];
+    perline = calloc(last + 1, sizeof(int64_t));
+    perproc = calloc(table->namesize, sizeof(int64_t));
+    list = malloc((last + 1 > table->namesize ? last + 1 : table->namesize) *
+		  sizeof(int64_t *));
+    for (i = j = 0; i < size; i++) {
+	while (j < table->procsize && range[j].first <= i)
+	    j++;
+	total += samples[i];
+	perline[line[i]] += samples[i];
+	if (j)
+	    perproc[range[j - 1].name] += samples[i];
+    }
+    if (!total)
+	total = 1;
+    fprintf(fp, "%12s%8s%12s\n", "samples", "%", "line");
+    for (i = k = 0; i <= last; i++)
+	if (perline[i])
+	    list[k++] = &perline[i];
+    qsort(list, k, sizeof(int64_t *), compare);
+    for (i = 0; i < k && i < maxhot; i++)
+	fprintf(fp, "%12" PRId64 "%7.2f%%%12u\n", *list[i],
+		100.0 * *list[i] / total, (uint32_t)(list[i] - perline));
+    fprintf(fp, "\n%12s%8s  %s\n", "samples", "%", "procedure");
+    for (i = k = 0; i < table->namesize; i++)
+	if (perproc[i])
+	    list[k++] = &perproc[i];
+    qsort(list, k, sizeof(int64_t *), compare);
+    for (i = 0; i < k; i++)
+	fprintf(fp, "%12" PRId64 "%7.2f%%  %s\n", *list[i],
+		100.0 * *list[i] / total, names + (list[i] - perproc));
+    free(list);
+    free(perproc);
+    free(perline);
+}
+
+/*
+    memoreport prints the hits and misses of the cache for each pure
+    procedure that is cached, by its entry, with the size of its key.
+*/
+static void memoreport(syreci *vm, FILE *fp)
+{
+    uint32_t i;
+    int64_t calls, hits = 0, misses = 0;
+    memo_t *memo;
+
+    fprintf(fp, "%12s%12s%8s%12s%12s\n", "hits", "misses", "%", "keys",
+	    "procedure");
+    for (i = 0; i < vm->nmemos; i++) {
+	memo = &vm->memos[i];
+	calls = memo->hits + memo->misses;
+	fprintf(fp, "%12" PRId64 "%12" PRId64 "%7.2f%%%12u%12u\n",
+		memo->hits, memo->misses,
+		calls ? 100.0 * memo->hits / calls : 0.0, memo->keys,
+		memo->entry);
+	hits += memo->hits;
+	misses += memo->misses;
+    }
+    calls = hits + misses;
+    fprintf(fp, "%12" PRId64 "%12" PRId64 "%7.2f%%%12s\n", hits, misses,
+	    calls ? 100.0 * hits / calls : 0.0, "total");
+}
+
+/*
+    leaders marks the instructions that start a basic block: the targets of
+    jumps and calls, and the instructions after a jump, call, return or halt.
+    Calls, returns and halts are blocks of their own. The other instructions
+    are executed as often as the instruction before them.
+*/
+static bool *leaders(instruction *image, uint32_t size)
+{
+    uint32_t i;
+    bool *leader = calloc(size + 1, sizeof(bool));
+
+    if (!leader)
+	return 0;
+    leader[1] = true;
+    for (i = 1; i < size; i++)
+	switch (image[i].op) {
+	case cal:
+	case jmp:
+	case jiz:
+	case jeql:
+	case jneq:
+	case jgtr:
+	case jgeq:
+	case jlss:
+	case jleq:
+	    if (image[i].adr1 < size)
+		leader[image[i].adr1] = true;
+	    leader[i + 1] = true;
+	    leader[i] |= image[i].op == cal;
+	    break;
+	case ret:
+	case hlt:
+	    leader[i] = leader[i + 1] = true;
+	    break;
+	default:
+	    break;
+	}
+    return leader;
+}
+
+/*
+    verify proves, once at load, what the interpreter and the JIT take for
+    granted: that the opcodes, registers, targets, frames, constants and
+    variables of the instructions are in range, that control does not run
+    off the end of the code, that the local variables of a procedure are
+    inside its frame, and that no store overwrites a return link that is
+    still needed, so that a return always goes back to the instruction after
+    its call. A procedure is the code that can be reached from instruction 1,
+    or from the target of a call, without following calls. When procedures
+    do not call themselves, directly or not, the deepest stack is computed
+    as well; when it fits, calls do not check for overflow. A program that
+    does not verify is rejected, with the instruction and the reason in
+    vm->diagnostic.
+*/
+enum { ANY, REG, PAIR, TARGET, FRAME, GLOBAL, LOCAL, CONST };
+
+static const char *const operandnames[] = {
+    "", "register", "register pair", "target", "frame", "global", "local",
+    "constant"
+};
+
+static const unsigned char operands[maxoper][2] = {
+    [add] = { REG, REG }, [sub] = { REG, REG }, [mul] = { REG, REG },
+    [dvd] = { REG, REG }, [mdl] = { REG, REG }, [eql] = { REG, REG },
+    [neq] = { REG, REG }, [gtr] = { REG, REG }, [geq] = { REG, REG },
+    [lss] = { REG, REG }, [leq] = { REG, REG }, [orr] = { REG, REG },
+    [neg] = { REG, ANY }, [loadglobl] = { REG, GLOBAL },
+    [loadlocal] = { REG, LOCAL }, [loadimmed] = { REG, ANY },
+    [storglobl] = { GLOBAL, REG }, [storlocal] = { LOCAL, REG },
+    [writebool] = { ANY, REG }, [writeint] = { ANY, REG },
+    [cal] = { TARGET, FRAME }, [ret] = { ANY, ANY }, [jmp] = { TARGET, ANY },
+    [jiz] = { TARGET, REG }, [hlt] = { ANY, ANY },
+    [addimmed] = { REG, ANY }, [addglobl] = { REG, GLOBAL },
+    [addlocal] = { REG, LOCAL }, [setglobl] = { GLOBAL, ANY },
+    [setlocal] = { LOCAL, ANY }, [incglobl] = { GLOBAL, ANY },
+    [inclocal] = { LOCAL, ANY }, [jeql] = { TARGET, PAIR },
+    [jneq] = { TARGET, PAIR }, [jgtr] = { TARGET, PAIR },
+    [jgeq] = { TARGET, PAIR }, [jlss] = { TARGET, PAIR },
+    [jleq] = { TARGET, PAIR }, [loadconst] = { REG, CONST },
+    [mov] = { REG, REG }
+};
+
+typedef struct proc_t {
+    uint32_t entry,
+	ret,			/* a return */
+	link,			/* a store to the return link */
+	zero,			/* a store to local variable 0 */
+	first, last,		/* the procedures it calls, in edges */
+	cursor;
+    int64_t frame, depth,
+	base;			/* the lowest base of its frame */
+    bool queued;
+    char state;			/* of the search for recursion */
+} proc_t;
+
+typedef struct verifier_t {
+    syreci *vm;
+    proc_t *procs;
+    uint32_t nprocs,
+	*procof,		/* 1 + the procedure that starts here */
+	*seen, stamp,		/* seen in the search with this stamp */
+	*work,
+	*edges, nedges, maxedges;
+    bool changed;		/* another procedure returns */
+} verifier_t;
+
+static bool reject(syreci *vm, uint32_t i, const char *format, int64_t x)
+{
+    int n = snprintf(vm->diagnostic, sizeof(vm->diagnostic),
+		     "instruction %u: ", i);
+
+    snprintf(vm->diagnostic + n, sizeof(vm->diagnostic) - n, format, x);
+    return false;
+}
+
+static bool isstore(operator op)
+{
+    return op == storglobl || op == setglobl || op == incglobl ||
+	   op == storlocal || op == setlocal || op == inclocal;
+}
+
+static bool islocal(operator op)
+{
+    return op == loadlocal || op == addlocal || op == storlocal ||
+	   op == setlocal || op == inclocal;
+}
+
+/*
+    operand checks the operands of instruction i.
+*/
+static bool operand(syreci *vm, uint32_t i)
+{
+    instruction *p = &vm->image[i];
+    int k, kind;
+    int64_t a;
+    bool bad;
+
+    if (p->op >= maxoper)
+	return reject(vm, i, "unknown opcode %" PRId64, p->op);
+    for (k = 0; k < 2; k++) {
+	a = k ? p->adr2 : p->adr1;
+	switch (kind = operands[p->op][k]) {
+	case REG:
+	    bad = (uint64_t)a > topregister;
+	    break;
+	case PAIR:
+	    bad = (uint64_t)a > 0xFF || LEFT(a) > topregister ||
+		  RIGHT(a) > topregister;
+	    break;
+	case TARGET:
+	    bad = a < 1 || a >= vm->hdr->codesize;
+	    break;
+	case FRAME:
+	case GLOBAL:
+	case LOCAL:
+	    bad = a < 0 || a > maxstack;
+	    break;
+	case CONST:
+	    bad = a < 0 || a >= vm->hdr->poolsize;
+	    break;
+	default:
+	    bad = false;
+	    break;
+	}
+	if (bad) {
+	    snprintf(vm->diagnostic, sizeof(vm->diagnostic),
+		     "instruction %u: %s %" PRId64 " out of range", i,
+		     operandnames[kind], a);
+	    return false;
+	}
+    }
+    return true;
+}
+
+/*
+    search follows procedure k from its entry, and finds the procedures
+    that it calls. A call continues with the next instruction only when the
+    procedure that it calls is known to return.
+*/
+static bool search(verifier_t *v, uint32_t k)
+{
+    syreci *vm = v->vm;
+    instruction *p;
+    proc_t *proc = &v->procs[k], *callee;
+    uint32_t i, t, *edges, top = 1, stamp = ++v->stamp;
+    int64_t a;
+    bool next;
+
+    proc->first = v->nedges;
+    v->seen[v->work[0] = proc->entry] = stamp;
+    while (top) {
+	p = &vm->image[i = v->work[--top]];
+	next = true;
+	t = 0;
+	switch (p->op) {
+	case hlt:
+	    next = false;
+	    break;
+	case ret:
+	    if (!proc->ret) {
+		proc->ret = i;
+		v->changed = true;
+	    }
+	    next = false;
+	    break;
+	case jmp:
+	    next = false;
+	    /* fall through */
+	case jiz:
+	case jeql:
+	case jneq:
+	case jgtr:
+	case jgeq:
+	case jlss:
+	case jleq:
+	    t = p->adr1;
+	    break;
+	case cal:
+	    if (k && p->adr2 < 2)
+		return reject(vm, i, "frame %" PRId64 " has no room for the "
+			      "return link", p->adr2);
+	    if (!v->procof[p->adr1]) {
+		v->procs[v->nprocs].entry = p->adr1;
+		v->procs[v->nprocs].frame = p->adr2;
+		v->procof[p->adr1] = ++v->nprocs;
+	    }
+	    callee = &v->procs[v->procof[p->adr1] - 1];
+	    if (callee->frame != p->adr2)
+		return reject(vm, i, "frame differs from frame %" PRId64
+			      " of another call", callee->frame);
+	    if (v->nedges == v->maxedges) {
+		if ((edges = realloc(v->edges, 2 * v->maxedges *
+				     sizeof(uint32_t))) == 0)
+		    return false;
+		v->edges = edges;
+		v->maxedges *= 2;
+	    }
+	    v->edges[v->nedges++] = callee - v->procs;
+	    next = callee->ret != 0;
+	    break;
+	default:
+	    if (!islocal(p->op))
+		break;
+	    a = isstore(p->op) ? p->adr1 : p->adr2;
+	    if (a > proc->frame)
+		return reject(vm, i, "local %" PRId64 " outside the frame", a);
+	    if (isstore(p->op) && (a == 1 || a == 2) && !proc->link)
+		proc->link = i;
+	    else if (isstore(p->op) && a == 0 && !proc->zero)
+		proc->zero = i;
+	    break;
+	}
+	if (next && i + 1 >= vm->hdr->codesize)
+	    return reject(vm, i, "runs off the end of the code", 0);
+	if (next && v->seen[i + 1] != stamp)
+	    v->seen[v->work[top++] = i + 1] = stamp;
+	if (t && v->seen[t] != stamp)
+	    v->seen[v->work[top++] = t] = stamp;
+    }
+    proc->last = v->nedges;
+    return true;
+}
+
+/*
+    recursive gives each procedure the depth of its frame and of the deepest
+    procedure that it calls, and returns whether procedures call themselves.
+*/
+static bool recursive(verifier_t *v)
+{
+    proc_t *proc, *callee;
+    uint32_t j, top = 1;
+    bool found = false;
+
+    v->work[0] = 0;
+    v->procs[0].state = 1;
+    v->procs[0].cursor = v->procs[0].first;
+    while (top) {
+	proc = &v->procs[v->work[top - 1]];
+	if (proc->cursor < proc->last) {
+	    callee = &v->procs[v->edges[proc->cursor++]];
+	    if (callee->state == 1)
+		found = true;
+	    else if (!callee->state) {
+		callee->state = 1;
+		callee->cursor = callee->first;
+		v->work[top++] = callee - v->procs;
+	    }
+	    continue;
+	}
+	proc->state = 2;
+	for (j = proc->first; j < proc->last; j++)
+	    if (proc->depth < v->procs[v->edges[j]].depth)
+		proc->depth = v->procs[v->edges[j]].depth;
+	proc->depth += proc->frame;
+	top--;
+    }
+    return found;
+}
+
+static syreci_status verify(syreci *vm)
+{
+    verifier_t v;
+    instruction *p;
+    proc_t *proc, *callee;
+    pureproc *pure;
+    uint32_t i, j, k, head, tail, size = vm->hdr->codesize, *var;
+    int64_t bound = INT64_MAX;
+    bool ok = true;
+
+    vm->diagnostic[0] = 0;
+    memset(&v, 0, sizeof(v));
+    v.vm = vm;
+    v.procs = calloc(size, sizeof(proc_t));
+    v.procof = calloc(size, sizeof(uint32_t));
+    v.seen = calloc(size, sizeof(uint32_t));
+    v.work = malloc(size * sizeof(uint32_t));
+    v.edges = malloc((v.maxedges = size) * sizeof(uint32_t));
+    if (!v.procs || !v.procof || !v.seen || !v.work || !v.edges)
+	ok = false;
+    for (i = 1; ok && i < size; i++)
+	ok = operand(vm, i);
+    /*
+	Procedure 0 starts at instruction 1, with base and top 0. The search
+	is repeated until no more procedures are found to return.
+    */
+    if (ok)
+	v.procs[0].entry = v.procof[1] = v.nprocs = 1;
+    for (v.changed = ok; ok && v.changed; ) {
+	v.changed = false;
+	v.nedges = 0;
+	for (k = 0; k < v.nprocs; k++)
+	    v.procs[k].link = v.procs[k].zero = 0;
+	for (k = 0; ok && k < v.nprocs; k++)
+	    ok = search(&v, k);
+    }
+    if (ok && v.procs[0].ret)
+	ok = reject(vm, v.procs[0].ret, "return outside a procedure", 0);
+    /*
+	Local variable 0 of a procedure is the top of the frame of its
+	caller, that holds a return link when the frame has no variables.
+    */
+    for (k = 0; ok && k < v.nprocs; k++) {
+	proc = &v.procs[k];
+	if (proc->ret && proc->frame < 2)
+	    ok = reject(vm, proc->entry, "frame %" PRId64 " has no room for "
+			"the return link", proc->frame);
+	else if (proc->ret && proc->link)
+	    ok = reject(vm, proc->link, "overwrites the return link", 0);
+	for (j = proc->first; ok && k && j < proc->last; j++) {
+	    callee = &v.procs[v.edges[j]];
+	    if (callee->zero && proc->ret && proc->frame == 2)
+		ok = reject(vm, callee->zero, "overwrites the return link of "
+			    "the procedure at %" PRId64, proc->entry);
+	}
+    }
+    /*
+	The base of a procedure is at least the lowest base of a procedure
+	that calls it plus the frame of that one; a global above the lowest
+	base of a procedure that returns can be its return link.
+    */
+    for (k = 0; ok && k < v.nprocs; k++)
+	v.procs[k].base = INT64_MAX;
+    if (ok) {
+	v.procs[0].base = 0;
+	v.procs[0].queued = true;
+	v.work[0] = 0;
+    }
+    for (head = 0, tail = ok; head != tail; ) {
+	proc = &v.procs[v.work[head]];
+	head = (head + 1) % size;
+	proc->queued = false;
+	for (j = proc->first; j < proc->last; j++) {
+	    callee = &v.procs[v.edges[j]];
+	    if (callee->base > proc->base + proc->frame) {
+		callee->base = proc->base + proc->frame;
+		if (!callee->queued) {
+		    callee->queued = true;
+		    v.work[tail] = callee - v.procs;
+		    tail = (tail + 1) % size;
+		}
+	    }
+	}
+    }
+    for (k = 0; ok && k < v.nprocs; k++)
+	if (v.procs[k].ret && bound > v.procs[k].base)
+	    bound = v.procs[k].base;
+    for (i = 1; ok && i < size; i++) {
+	p = &vm->image[i];
+	if (v.seen[i] && isstore(p->op) && !islocal(p->op) &&
+	    p->adr1 > bound)
+	    ok = reject(vm, i, "global %" PRId64 " can overwrite a return "
+			"link", p->adr1);
+    }
+    /*
+	A pure procedure is trusted when it is called and returns, and the
+	globals that it writes, that a hit of the cache sets, are held to the
+	same bound as stores. The others are not cached: the table is only a
+	hint, that does not make the program invalid.
+    */
+    if (ok && vm->pure && (vm->options & SYRECI_MEMO)) {
+	if ((vm->trusted = calloc(vm->pure->procsize + 1,
+				  sizeof(bool))) == 0)
+	    ok = false;
+	pure = (pureproc *)(vm->pure + 1);
+	var = (uint32_t *)(pure + vm->pure->procsize);
+	for (i = 0; ok && i < vm->pure->procsize; i++, pure++) {
+	    k = v.procof[pure->entry];
+	    vm->trusted[i] = k && v.procs[k - 1].ret;
+	    var += pure->keys;
+	    for (j = 0; j < pure->writes; j++, var++)
+		if (*var > bound)
+		    vm->trusted[i] = false;
+	}
+    }
+    if (ok)
+	vm->maxdepth = recursive(&v) ? -1 : v.procs[0].depth;
+    free(v.procs);
+    free(v.procof);
+    free(v.seen);
+    free(v.work);
+    free(v.edges);
+    if (!ok && !vm->diagnostic[0])
+	return SYRECI_MEMORY;
+    return ok ? SYRECI_OK : SYRECI_INVALID;
+}
+
+/*
+    The hardware counters of -e are opened as one group that is read in one
+    call. A counter that cannot be opened is left out; when none can be
+    opened, only the instructions of the machine are counted. The group is
+    opened once, for the process. Between two calls or returns, the counters
+    are added to the procedure on top of the procstack of the machine. On
+    x86-64 the counters are read with rdpmc, without a system call, when the
+    kernel allows it.
+*/
+static char *eventnames[maxevent] = {
+    "cycles", "instructions", "branch-misses", "L1d-misses"
+};
+static int eventfd = -1, eventslot[maxevent];
+static bool eventsopen;
+
+#if defined(__linux__) && defined(__x86_64__)
+#define userpmc true
+
+static struct perf_event_mmap_page *eventpage[maxevent];
+
+/*
+    userread reads a counter from user mode, following the protocol of the
+    mapped page; it returns false when the counter cannot be read that way.
+*/
+static bool userread(struct perf_event_mmap_page *page, uint64_t *value)
+{
+    uint32_t seq, index, low, high;
+    int64_t count, pmc;
+
+    do {
+	seq = page->lock;
+	__asm__ volatile ("" ::: "memory");
+	index = page->index;
+	count = page->offset;
+	if (!page->cap_user_rdpmc || !index)
+	    return false;
+	__asm__ volatile ("rdpmc" : "=a" (low), "=d" (high) : "c" (index - 1));
+	pmc = (int64_t)((uint64_t)high << 32 | low);
+	pmc <<= 64 - page->pmc_width;
+	pmc >>= 64 - page->pmc_width;
+	count += pmc;
+	__asm__ volatile ("" ::: "memory");
+    } while (page->lock != seq);
+    *value = count;
+    return true;
+}
+#else
+#define userpmc false
+#endif
+
+/*
+    readevents reads the counters that could be opened; the others are 0.
+*/
+static void readevents(uint64_t *values)
+{
+    int i;
+    uint64_t buf[maxevent + 1] = { 0 };
+
+#if userpmc
+    for (i = 0; i < maxevent; i++)
+	if (eventslot[i] < 0)
+	    values[i] = 0;
+	else if (!eventpage[i] || !userread(eventpage[i], &values[i]))
+	    break;
+    if (i == maxevent)
+	return;
+#endif
+    if (eventfd < 0 || read(eventfd, buf, sizeof(buf)) <= 0)
+	buf[0] = 0;
+    for (i = 0; i < maxevent; i++)
+	values[i] = eventslot[i] >= 0 && (uint64_t)eventslot[i] < buf[0] ?
+		    buf[eventslot[i] + 1] : 0;
+}
+
+/*
+    openevents opens and starts the counters for this process in user mode,
+    the first time it is called.
+*/
+static void openevents(void)
+{
+    int i;
+#ifdef __linux__
+    int fd, count = 0;
+    static const struct {
+	uint32_t type;
+	uint64_t config;
+    } kinds[maxevent] = {
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+	  PERF_COUNT_HW_CACHE_OP_READ << 8 |
+	  PERF_COUNT_HW_CACHE_RESULT_MISS << 16 }
+    };
+    struct perf_event_attr attr;
+#endif
+
+    if (eventsopen)
+	return;
+    eventsopen = true;
+    for (i = 0; i < maxevent; i++) {
+	eventslot[i] = -1;
+#ifdef __linux__
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = kinds[i].type;
+	attr.config = kinds[i].config;
+	attr.disabled = eventfd < 0;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP;
+	fd = syscall(SYS_perf_event_open, &attr, 0, -1, eventfd, 0);
+	if (fd < 0)
+	    continue;
+	if (eventfd < 0)
+	    eventfd = fd;
+	eventslot[i] = count++;
+#if userpmc
+	eventpage[i] = mmap(0, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED,
+			    fd, 0);
+	if (eventpage[i] == MAP_FAILED)
+	    eventpage[i] = 0;
+#endif
+#endif
+    }
+    if (eventfd < 0) {
+	fprintf(stderr, "hardware counters are not available\n");
+	return;
+    }
+#ifdef __linux__
+    ioctl(eventfd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(eventfd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+/*
+    credit adds the counters since the last call or return to the current
+    procedure.
+*/
+static void credit(syreci *vm)
+{
+    int i;
+    uint64_t now[maxevent],
+	*sum = &vm->perproc[vm->procstack[vm->proctop] * maxevent];
+
+    readevents(now);
+    for (i = 0; i < maxevent; i++) {
+	sum[i] += now[i] - vm->lastevent[i];
+	vm->lastevent[i] = now[i];
+    }
+}
+
+/*
+    measure credits the current procedure, before instruction ins is
+    executed, and follows ins to another procedure.
+*/
+static void measure(syreci *vm, instruction *ins)
+{
+    credit(vm);
+    if (ins->op == cal && vm->proctop < maxstack)
+	vm->procstack[++vm->proctop] = ins->adr1;
+    else if (ins->op == ret && vm->proctop > 0)
+	vm->proctop--;
+}
+
+/*
+    eventrow prints the counters and the instructions of the machine, with
+    the cycles per instruction, for the procedure in name.
+*/
+static void eventrow(uint64_t *sum, int64_t count, char *name, FILE *fp)
+{
+    int i;
+
+    for (i = 0; i < maxevent; i++)
+	if (eventslot[i] < 0)
+	    fprintf(fp, "%14s", "n/a");
+	else
+	    fprintf(fp, "%14" PRIu64, sum[i]);
+    if (eventslot[0] >= 0 && count)
+	fprintf(fp, "%14" PRId64 "%10.2f  %s\n", count,
+		(double)sum[0] / count, name);
+    else
+	fprintf(fp, "%14" PRId64 "%10s  %s\n", count, "n/a", name);
+}
+
+/*
+    events prints the counters for the whole run and for each procedure, the
+    procedure with the most instructions first. The counts of instructions
+    that are not leaders are filled in first; a procedure is named by the
+    line table, or by the index of its first instruction.
+*/
+static void events(syreci *vm, FILE *fp)
+{
+    instruction *image = vm->image;
+    uint32_t i, j, k, entry, size = vm->hdr->codesize;
+    int64_t *counts = vm->counts;
+    uint64_t *perproc = vm->perproc;
+    bool *leader = vm->leader;
+    linetable *lines = vm->lines;
+    int64_t total = 0, *inside, **list;
+    uint64_t whole[maxevent] = { 0 };
+    bool *entries;
+    procrange *range = 0;
+    char name[24], *names = 0;
+
+    for (i = 2; leader && i < size; i++)
+	if (!leader[i])
+	    counts[i] = counts[i - 1];
+    inside = calloc(size, sizeof(int64_t));
+    entries = calloc(size, sizeof(bool));
+    list = malloc(size * sizeof(int64_t *));
+    for (i = 1; i < size; i++)
+	if (image[i].op == cal && counts[i])
+	    entries[image[i].adr1] = true;
+    for (entry = 0, i = 1; i < size; i++) {
+	if (entries[i])
+	    entry = i;
+	inside[entry] += counts[i];
+	total += counts[i];
+    }
+    for (i = 0; i < size; i++)
+	for (j = 0; j < maxevent; j++)
+	    whole[j] += perproc[i * maxevent + j];
+    for (i = k = 0; i < size; i++)
+	if (entries[i])
+	    list[k++] = &inside[i];
+    qsort(list, k, sizeof(int64_t *), compare);
+    if (lines) {
+	range = (procrange *)((uint32_t *)(lines + 1) + size);
+	names = (char *)(range + lines->procsize);
+    }
+    fprintf(fp, "%14s%14s%14s%14s%14s%10s  %s\n", eventnames[0],
+	    eventnames[1], eventnames[2], eventnames[3], "vm-instr",
+	    "cycles/vm", "procedure");
+    eventrow(whole, total, "(total)", fp);
+    for (i = 0; i < k; i++) {
+	entry = list[i] - inside;
+	sprintf(name, "%u", entry);
+	for (j = 0; lines && j < lines->procsize && range[j].first <= entry;
+	     j++)
+	    ;
+	eventrow(&perproc[(size_t)entry * maxevent], *list[i],
+		 j ? names + range[j - 1].name : name, fp);
+    }
+    free(list);
+    free(entries);
+    free(inside);
+}
+
+/* ------------------------------- J I T ---------------------------------- */
+
+/*
+    The JIT translates each instruction into a template of x86-64 code. The
+    registers of the virtual machine are kept in machine registers; rsi points
+    to the stack, r10 holds baseregister and r11 holds stacktop, and the
+    machine is kept on the native stack, for the calls of putint and putbool.
+    Other architectures use the interpreter.
+*/
+#if jitted
+#define RAX	0
+#define RCX	1
+#define RDX	2
+#define RSP	4
+#define RDI	7
+#define STACK	6	/* rsi */
+#define BASE	10	/* r10 */
+#define TOP	11	/* r11 */
+#define NOINDEX	-1
+
+#define maxbytes 96	/* maximum size of the template of one instruction */
+
+/* rbx, rbp, r12, r13, r14, r15, r8, r9 */
+static int machine[topregister + 1] = { 3, 5, 12, 13, 14, 15, 8, 9 };
+
+/* condition codes of jcc and setcc, for eql, neq, gtr, geq, lss, leq */
+static int condition[] = { 4, 5, 15, 13, 12, 14 };
+
+static THREADLOCAL unsigned char *jp;
+
+static void byte(int b)
+{
+    *jp++ = b;
+}
+
+static void word(int32_t w)
+{
+    memcpy(jp, &w, sizeof(w));
+    jp += sizeof(w);
+}
+
+static void quad(int64_t q)
+{
+    memcpy(jp, &q, sizeof(q));
+    jp += sizeof(q);
+}
+
+/*
+    rex emits a REX prefix with W set; r extends the reg field, x the index and
+    b the base or r/m field.
+*/
+static void rex(int r, int x, int b)
+{
+    byte(0x48 | (r >> 3) << 2 | (x >> 3) << 1 | b >> 3);
+}
+
+/*
+    rr emits an instruction with register operands: reg is r, r/m is b.
+*/
+static void rr(int op, int r, int b)
+{
+    rex(r, 0, b);
+    byte(op);
+    byte(0xC0 | (r & 7) << 3 | (b & 7));
+}
+
+/*
+    rm emits an instruction with a memory operand [rsi + index * 8 + disp].
+*/
+static void rm(int op, int r, int index, int32_t disp)
+{
+    rex(r, index == NOINDEX ? 0 : index, STACK);
+    byte(op);
+    if (index == NOINDEX)
+	byte(0x80 | (r & 7) << 3 | STACK);
+    else {
+	byte(0x80 | (r & 7) << 3 | 4);
+	byte(0xC0 | (index & 7) << 3 | STACK);
+    }
+    word(disp);
+}
+
+static void push(int r)
+{
+    if (r >= 8)
+	byte(0x41);
+    byte(0x50 | (r & 7));
+}
+
+static void pop(int r)
+{
+    if (r >= 8)
+	byte(0x41);
+    byte(0x58 | (r & 7));
+}
+
+/*
+    call calls a C function with the machine and register r as arguments,
+    saving the registers that the function may clobber. The stack remains
+    aligned at 16 bytes.
+*/
+static void call(void *fun, int r)
+{
+    push(STACK);
+    push(8);
+    push(9);
+    push(BASE);
+    push(TOP);
+    rr(0x83, 5, RSP);		/* sub rsp, 8 */
+    byte(8);
+    rr(0x89, r, STACK);		/* mov rsi, r */
+    rex(RDI, 0, 0);		/* mov rdi, [rsp + 48] */
+    byte(0x8B);
+    byte(0x44 | RDI << 3);
+    byte(0x24);
+    byte(48);
+    rex(0, 0, RAX);		/* mov rax, fun */
+    byte(0xB8);
+    quad((int64_t)fun);
+    byte(0xFF);			/* call rax */
+    byte(0xD0);
+    rr(0x83, 0, 4);		/* add rsp, 8 */
+    byte(8);
+    pop(TOP);
+    pop(BASE);
+    pop(9);
+    pop(8);
+    pop(STACK);
+}
+
+/*
+    stop returns index i of the instruction where the native code stops.
+*/
+static void stop(uint32_t i)
+{
+    byte(0xB8);			/* mov eax, i */
+    word(i);
+    rr(0x83, 0, RSP);		/* add rsp, 8 */
+    byte(8);
+    pop(15);
+    pop(14);
+    pop(13);
+    pop(12);
+    pop(5);
+    pop(3);
+    byte(0xC3);			/* ret */
+}
+
+/*
+    skip emits a short jump, with opcode op, that is resolved by land.
+*/
+static unsigned char *skip(int op)
+{
+    byte(op);
+    byte(0);
+    return jp;
+}
+
+static void land(unsigned char *from)
+{
+    from[-1] = jp - from;
+}
+
+/*
+    compile translates the program to native code. Jumps are resolved after all
+    instructions have been translated; returns go through table, that maps an
+    instruction index to a native address. compile returns false when the
+    program uses operands that the templates do not support, or when there is
+    no memory for the tables; the program is then interpreted.
+*/
+static bool compile(syreci *vm)
+{
+    instruction *pc, *code = vm->image;
+    unsigned char *buf, **table, *over, *minus, *done;
+    uint32_t i, j, *fixup, *target, nfix = 0, size = vm->hdr->codesize,
+	poolsize = vm->hdr->poolsize;
+    int64_t *pool = vm->pool;
+    size_t length = (size_t)size * maxbytes + 64;
+    int a, b;
+    bool bounded = vm->maxdepth >= 0 && vm->maxdepth <= maxstack;
+
+    buf = mmap(0, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+	       -1, 0);
+    if (buf == MAP_FAILED)
+	return false;
+    table = malloc(size * sizeof(unsigned char *));
+    fixup = malloc(size * sizeof(uint32_t));
+    target = malloc(size * sizeof(uint32_t));
+    if (!table || !fixup || !target)
+	goto fail;
+    jp = buf;
+    push(3);			/* prologue */
+    push(5);
+    push(12);
+    push(13);
+    push(14);
+    push(15);
+    push(RDI);			/* the machine */
+    rr(0x31, BASE, BASE);	/* xor r10, r10 */
+    rr(0x31, TOP, TOP);		/* xor r11, r11 */
+    byte(0xE9);			/* jmp code[1] */
+    fixup[nfix] = jp - buf;
+    target[nfix++] = 1;
+    word(0);
+    for (i = 0; i < size; i++) {
+	pc = &code[i];
+	table[i] = jp;
+	a = pc->adr1;
+	b = pc->adr2;
+	switch (pc->op) {
+	case add:
+	case sub:
+	case mul:
+	case dvd:
+	case mdl:
+	case eql:
+	case neq:
+	case gtr:
+	case geq:
+	case lss:
+	case leq:
+	case orr:
+	case mov:
+	    if (a > topregister || b < 0 || b > topregister)
+		goto fail;
+	    a = machine[a];
+	    b = machine[b];
+	    break;
+	case neg:
+	case loadglobl:
+	case loadlocal:
+	case loadimmed:
+	case addimmed:
+	case addglobl:
+	case addlocal:
+	    if (a > topregister)
+		goto fail;
+	    a = machine[a];
+	    break;
+	case loadconst:
+	    if (a > topregister || b < 0 || (uint32_t)b >= poolsize)
+		goto fail;
+	    a = machine[a];
+	    break;
+	case storglobl:
+	case storlocal:
+	case writebool:
+	case writeint:
+	case jiz:
+	    if (b < 0 || b > topregister)
+		goto fail;
+	    b = machine[b];
+	    break;
+	case jeql:
+	case jneq:
+	case jgtr:
+	case jgeq:
+	case jlss:
+	case jleq:
+	    if (LEFT(b) > topregister || RIGHT(b) > topregister)
+		goto fail;
+	    break;
+	default:
+	    break;
+	}
+	if ((pc->op == loadglobl || pc->op == loadlocal ||
+	     pc->op == addglobl || pc->op == addlocal) &&
+	    (b < -0x10000000 || b >= 0x10000000))
+	    goto fail;
+	switch (pc->op) {
+	case add:
+	    rr(0x01, b, a);
+	    break;
+	case sub:
+	    rr(0x29, b, a);
+	    break;
+	case mul:
+	    rex(a, 0, b);		/* imul a, b */
+	    byte(0x0F);
+	    byte(0xAF);
+	    byte(0xC0 | (a & 7) << 3 | (b & 7));
+	    break;
+	case dvd:
+	case mdl:
+	    rr(0x85, b, b);		/* test b, b */
+	    over = skip(0x75);		/* jnz over */
+	    stop(i);
+	    land(over);
+	    rr(0x83, 7, b);		/* cmp b, -1 */
+	    byte(0xFF);
+	    minus = skip(0x75);		/* jne over the negation */
+	    if (pc->op == dvd)
+		rr(0xF7, 3, a);		/* neg a */
+	    else
+		rr(0x31, a, a);		/* xor a, a */
+	    done = skip(0xEB);		/* jmp over the division */
+	    land(minus);
+	    rr(0x89, a, RAX);		/* mov rax, a */
+	    rex(0, 0, 0);		/* cqo */
+	    byte(0x99);
+	    rr(0xF7, 7, b);		/* idiv b */
+	    rr(0x89, pc->op == dvd ? RAX : RDX, a);
+	    land(done);
+	    break;
+	case eql:
+	case neq:
+	case gtr:
+	case geq:
+	case lss:
+	case leq:
+	    rr(0x39, b, a);		/* cmp a, b */
+	    byte(0x0F);			/* setcc al */
+	    byte(0x90 | condition[pc->op - eql]);
+	    byte(0xC0);
+	    byte(0x0F);			/* movzx eax, al */
+	    byte(0xB6);
+	    byte(0xC0);
+	    rr(0x89, RAX, a);
+	    break;
+	case orr:
+	    rr(0x83, 7, a);		/* cmp a, 1 */
+	    byte(1);
+	    byte(0x0F);			/* sete al */
+	    byte(0x94);
+	    byte(0xC0);
+	    rr(0x83, 7, b);		/* cmp b, 1 */
+	    byte(1);
+	    byte(0x0F);			/* sete cl */
+	    byte(0x94);
+	    byte(0xC1);
+	    byte(0x08);			/* or al, cl */
+	    byte(0xC8);
+	    byte(0x0F);			/* movzx eax, al */
+	    byte(0xB6);
+	    byte(0xC0);
+	    rr(0x89, RAX, a);
+	    break;
+	case neg:
+	    rr(0xF7, 3, a);		/* neg a */
+	    rr(0x83, 0, a);		/* add a, 1 */
+	    byte(1);
+	    break;
+	case loadglobl:
+	    rm(0x8B, a, NOINDEX, b * 8);
+	    break;
+	case loadlocal:
+	    rm(0x8B, a, BASE, b * 8);
+	    break;
+	case loadimmed:
+	    rr(0xC7, 0, a);
+	    word(b);
+	    break;
+	case loadconst:
+	    rex(0, 0, a);		/* mov a, imm64 */
+	    byte(0xB8 | (a & 7));
+	    quad(pool[b]);
+	    break;
+	case storglobl:
+	    rm(0x89, b, NOINDEX, a * 8);
+	    break;
+	case storlocal:
+	    rm(0x89, b, BASE, a * 8);
+	    break;
+	case writebool:
+	    call((void *)putbool, b);
+	    break;
+	case writeint:
+	    call((void *)putint, b);
+	    break;
+	case cal:
+	    rex(RAX, 0, TOP);		/* lea rax, [r11 + b] */
+	    byte(0x8D);
+	    byte(0x80 | (TOP & 7));
+	    word(b);
+	    if (!bounded) {
+		rex(0, 0, RAX);		/* cmp rax, maxstack */
+		byte(0x3D);
+		word(maxstack);
+		byte(0x0F);		/* jle over the call */
+		byte(0x8E);
+		word(0);
+		j = jp - buf;
+		stop(i);
+		memcpy(buf + j - 4, &(int32_t){ jp - buf - j }, 4);
+	    }
+	    rm(0x89, BASE, TOP, 8);	/* stack[stacktop + 1] = baseregister */
+	    rm(0xC7, 0, TOP, 16);	/* stack[stacktop + 2] = i + 1 */
+	    word(i + 1);
+	    rr(0x89, TOP, BASE);	/* baseregister = stacktop */
+	    rr(0x89, RAX, TOP);		/* stacktop += b */
+	    /* fall through */
+	case jmp:
+	    if (a >= (int)size)
+		goto fail;
+	    byte(0xE9);
+	    fixup[nfix] = jp - buf;
+	    target[nfix++] = a;
+	    word(0);
+	    break;
+	case ret:
+	    rr(0x89, BASE, TOP);	/* stacktop = baseregister */
+	    rm(0x8B, BASE, TOP, 8);	/* baseregister = stack[stacktop + 1] */
+	    rm(0x8B, RAX, TOP, 16);	/* rax = stack[stacktop + 2] */
+	    rex(0, 0, RCX);		/* mov rcx, table */
+	    byte(0xB8 | RCX);
+	    quad((int64_t)table);
+	    byte(0xFF);			/* jmp [rcx + rax * 8] */
+	    byte(0x24);
+	    byte(0xC1);
+	    break;
+	case jiz:
+	case jeql:
+	case jneq:
+	case jgtr:
+	case jgeq:
+	case jlss:
+	case jleq:
+	    if (a >= (int)size)
+		goto fail;
+	    if (pc->op == jiz)
+		rr(0x85, b, b);		/* test b, b */
+	    else
+		rr(0x39, machine[RIGHT(b)], machine[LEFT(b)]);
+	    byte(0x0F);			/* jcc */
+	    byte(0x80 | (pc->op == jiz ? 4 : condition[pc->op - jeql]));
+	    fixup[nfix] = jp - buf;
+	    target[nfix++] = a;
+	    word(0);
+	    break;
+	case hlt:
+	    stop(i);
+	    break;
+	case addimmed:
+	    rr(0x81, 0, a);
+	    word(b);
+	    break;
+	case addglobl:
+	    rm(0x03, a, NOINDEX, b * 8);
+	    break;
+	case addlocal:
+	    rm(0x03, a, BASE, b * 8);
+	    break;
+	case setglobl:
+	    rm(0xC7, 0, NOINDEX, a * 8);
+	    word(b);
+	    break;
+	case setlocal:
+	    rm(0xC7, 0, BASE, a * 8);
+	    word(b);
+	    break;
+	case incglobl:
+	    rm(0x81, 0, NOINDEX, a * 8);
+	    word(b);
+	    break;
+	case inclocal:
+	    rm(0x81, 0, BASE, a * 8);
+	    word(b);
+	    break;
+	case mov:
+	    rr(0x89, b, a);
+	    break;
+	default:
+	    goto fail;
+	}
+    }
+    for (j = 0; j < nfix; j++)
+	memcpy(buf + fixup[j], &(int32_t){ table[target[j]] - buf - fixup[j] - 4 },
+	       4);
+    free(fixup);
+    free(target);
+    if (mprotect(buf, length, PROT_READ | PROT_EXEC)) {
+	free(table);
+	munmap(buf, length);
+	return false;
+    }
+    vm->native = (native_t)buf;
+    vm->nativesize = length;
+    vm->table = table;
+    return true;
+fail:
+    free(fixup);
+    free(target);
+    free(table);
+    munmap(buf, length);
+    return false;
+}
+#endif
+
+/*
+    memoize makes the cache for the pure procedures that verify trusts, with
+    keys and writes of at most maxkey variables.
+*/
+static bool memoize(syreci *vm)
+{
+    uint32_t i, *var;
+    pureproc *proc;
+    memo_t *memo;
+
+    if (!vm->pure)
+	return true;
+    proc = (pureproc *)(vm->pure + 1);
+    var = (uint32_t *)(proc + vm->pure->procsize);
+    if ((vm->memos = calloc(vm->pure->procsize + 1, sizeof(memo_t))) == 0 ||
+	(vm->memoof = calloc(vm->hdr->codesize, sizeof(uint32_t))) == 0 ||
+	(vm->cache = calloc(memosize * (1 + 2 * maxkey),
+			    sizeof(int64_t))) == 0 ||
+	(vm->pending = malloc(maxpending * sizeof(pending_t))) == 0)
+	return false;
+    for (i = 0; i < vm->pure->procsize; var += proc->keys + proc->writes,
+	 proc++, i++) {
+	if (!vm->trusted[i] || proc->keys > maxkey ||
+	    proc->writes > maxkey || vm->memoof[proc->entry])
+	    continue;
+	memo = &vm->memos[vm->nmemos];
+	memo->entry = proc->entry;
+	memo->keys = proc->keys;
+	memo->writes = proc->writes;
+	memo->var = var;
+	vm->memoof[proc->entry] = ++vm->nmemos;
+    }
+    return true;
+}
+
+/*
+    cached answers a call of the pure procedure at entry from the cache: when
+    the entry of its key holds that key, the variables that the procedure
+    writes are set and true is returned. Otherwise the call is pending, with
+    the base of its frame, so that its return fills the entry.
+*/
+static bool cached(syreci *vm, uint32_t entry, int64_t *stack, int64_t base)
+{
+    uint32_t k, m = vm->memoof[entry];
+    uint64_t h = m;
+    int64_t *slot;
+    memo_t *memo = &vm->memos[m - 1];
+    pending_t *p;
+
+    for (k = 0; k < memo->keys; k++)
+	h = (h ^ (uint64_t)stack[memo->var[k]]) * 1099511628211ULL;
+    slot = &vm->cache[((h ^ h >> 32) & (memosize - 1)) * (1 + 2 * maxkey)];
+    if (slot[0] == m) {
+	for (k = 0; k < memo->keys && slot[1 + k] == stack[memo->var[k]]; k++)
+	    ;
+	if (k == memo->keys) {
+	    for (k = 0; k < memo->writes; k++)
+		stack[memo->var[memo->keys + k]] = slot[1 + maxkey + k];
+	    memo->hits++;
+	    return true;
+	}
+    }
+    memo->misses++;
+    if (vm->npending < maxpending) {
+	p = &vm->pending[vm->npending++];
+	p->memo = m;
+	p->slot = slot - vm->cache;
+	p->base = base;
+	for (k = 0; k < memo->keys; k++)
+	    p->key[k] = stack[memo->var[k]];
+    }
+    return false;
+}
+
+/*
+    keep fills the entry of the pending call that returns.
+*/
+static void keep(syreci *vm, int64_t *stack)
+{
+    uint32_t k;
+    pending_t *p = &vm->pending[--vm->npending];
+    memo_t *memo = &vm->memos[p->memo - 1];
+    int64_t *slot = &vm->cache[p->slot];
+
+    slot[0] = p->memo;
+    memcpy(slot + 1, p->key, memo->keys * sizeof(int64_t));
+    for (k = 0; k < memo->writes; k++)
+	slot[1 + maxkey + k] = stack[memo->var[memo->keys + k]];
+}
+
+/*
+    countblocks gives each leader the length of its basic block, that tick
+    takes from the budget.
+*/
+static bool countblocks(syreci *vm)
+{
+    uint32_t i, first = 0, size = vm->hdr->codesize;
+
+    if (!vm->leader && (vm->leader = leaders(vm->image, size)) == 0)
+	return false;
+    if ((vm->blocks = calloc(size, sizeof(int64_t))) == 0)
+	return false;
+    for (i = 1; i < size; i++) {
+	if (vm->leader[i])
+	    first = i;
+	vm->blocks[first]++;
+    }
+    return true;
+}
+
+/*
+    execute interprets the program, from where it stopped, until it halts,
+    fails, or uses the budget. The registers are copied to local variables
+    while the program runs. The first run translates the instructions into
+    threaded code; a run with a budget translates them again, when needed,
+    such that the leaders go to tick first.
+*/
+static syreci_status execute(syreci *vm, int64_t budget)
+{
+    instruction *image = vm->image;
+    code_t *code, *pc;
+    int64_t *pool = vm->pool, *stack = vm->stack, *counts = vm->counts;
+    uint32_t *memoof = vm->memoof;
+    int64_t stacktop = vm->stacktop, baseregister = vm->baseregister;
+    int64_t reg[topregister + 1], left = budget ? budget : INT64_MAX,
+	limit = left;
+    bool counting = vm->options & SYRECI_EVENTS,
+	bounded = vm->maxdepth >= 0 && vm->maxdepth <= maxstack;
+    syreci_status status;
+#if threaded
+    uint32_t i, size = vm->hdr->codesize;
+    void *label, *handler, **handlers = vm->handlers, **stubs;
+    int64_t *blocks;
+    static void *labels[] = {
+	[add] = &&do_add, [sub] = &&do_sub, [mul] = &&do_mul,
+	[dvd] = &&do_dvd, [mdl] = &&do_mdl, [eql] = &&do_eql,
+	[neq] = &&do_neq, [gtr] = &&do_gtr, [geq] = &&do_geq,
+	[lss] = &&do_lss, [leq] = &&do_leq, [orr] = &&do_orr,
+	[neg] = &&do_neg, [loadglobl] = &&do_loadglobl,
+	[loadlocal] = &&do_loadlocal, [loadimmed] = &&do_loadimmed,
+	[storglobl] = &&do_storglobl, [storlocal] = &&do_storlocal,
+	[writebool] = &&do_writebool, [writeint] = &&do_writeint,
+	[cal] = &&do_cal, [ret] = &&do_ret, [jmp] = &&do_jmp,
+	[jiz] = &&do_jiz, [hlt] = &&do_hlt, [addimmed] = &&do_addimmed,
+	[addglobl] = &&do_addglobl, [addlocal] = &&do_addlocal,
+	[setglobl] = &&do_setglobl, [setlocal] = &&do_setlocal,
+	[incglobl] = &&do_incglobl, [inclocal] = &&do_inclocal,
+	[jeql] = &&do_jeql, [jneq] = &&do_jneq, [jgtr] = &&do_jgtr,
+	[jgeq] = &&do_jgeq, [jlss] = &&do_jlss, [jleq] = &&do_jleq,
+	[loadconst] = &&do_loadconst, [mov] = &&do_mov
+    };
+#else
+    int64_t *blocks;
+    bool sampling = vm->options & SYRECI_SAMPLE;
+    operator prev = hlt;
+#endif
+
+    if (budget && !vm->blocks && !countblocks(vm))
+	return SYRECI_MEMORY;
+#if threaded
+    /*
+	The profilers send every instruction to count, that counts it, or to
+	track, that makes it the current instruction, before going to the
+	handler. With -e only leaders are counted, and calls, returns and
+	halts go to measure. A budget sends the leaders to tick, before the
+	profilers.
+    */
+    if (budget && !vm->stubs &&
+	(vm->stubs = malloc(size * sizeof(void *))) == 0)
+	return SYRECI_MEMORY;
+    code = vm->code;
+    stubs = vm->stubs;
+    blocks = vm->blocks;
+    if (!vm->translated || (budget && !vm->ticked)) {
+	for (i = 0; i < size; i++) {
+	    handler = image[i].op == cal && memoof &&
+		      memoof[image[i].adr1] ? &&do_memo :
+		      image[i].op == ret && memoof ? &&do_memoret :
+		      image[i].op == cal && bounded ? &&do_bounded :
+		      labels[image[i].op];
+	    if (handlers)
+		handlers[i] = handler;
+	    if (counting)
+		label = image[i].op == cal || image[i].op == ret ||
+			image[i].op == hlt ? &&event : vm->leader[i] ?
+			&&count : handler;
+	    else if (vm->options & SYRECI_PROFILE)
+		label = &&count;
+	    else if (vm->options & SYRECI_SAMPLE)
+		label = &&track;
+	    else
+		label = handler;
+	    if (budget) {
+		stubs[i] = label;
+		if (blocks[i])
+		    label = &&tick;
+	    }
+	    code[i].label = label;
+	    code[i].adr1 = image[i].adr1;
+	    code[i].adr2 = image[i].adr2;
+	}
+	vm->translated = true;
+	vm->ticked = budget != 0;
+    }
+#else
+    code = image;
+    blocks = budget ? vm->blocks : 0;
+#endif
+    memcpy(reg, vm->reg, sizeof(reg));
+    vm->started = true;
+    if (counting) {
+	openevents();
+	readevents(vm->lastevent);
+    }
+#ifndef _WIN32
+    if (vm->options & SYRECI_SAMPLE) {
+	samples = vm->samples;
+	codebase = code;
+	startsampling();
+    }
+#endif
+
+    /* interpret: */
+    if (tracing)
+	printf("interpreting ...\n");
+    pc = &code[vm->pc];
+#if threaded
+    NEXT;
+#else
+    for (;;) {
+	if (blocks && blocks[pc - code]) {
+	    if (left <= 0) {
+		status = SYRECI_BUDGET;
+		goto stop;
+	    }
+	    left -= blocks[pc - code];
+	}
+	if (tracing)
+	    debug(vm, pc, code);
+	if (counts)
+	    counts[pc - code]++;
+	if (counting && (pc->op == cal || pc->op == ret || pc->op == hlt))
+	    measure(vm, pc);
+	if (sampling)
+	    current = pc;
+	if (pairstats) {
+	    pairs[prev][pc->op]++;
+	    prev = pc->op;
+	}
+	switch (pc->op) {
+#endif
+	CASE(add):
+	    reg[pc->adr1] = WRAP(reg[pc->adr1], +, reg[pc->adr2]);
+	    pc++;
+	    NEXT;
+
+	CASE(sub):
+	    reg[pc->adr1] = WRAP(reg[pc->adr1], -, reg[pc->adr2]);
+	    pc++;
+	    NEXT;
+
+	CASE(mul):
+	    reg[pc->adr1] = WRAP(reg[pc->adr1], *, reg[pc->adr2]);
+	    pc++;
+	    NEXT;
+
+	CASE(dvd):
+	    if (ZEROONE(reg[pc->adr2])) {
+		if (!reg[pc->adr2]) {
+		    status = SYRECI_DIVIDE;
+		    goto stop;
+		}
+		reg[pc->adr1] = -(uint64_t)reg[pc->adr1];
+	    } else
+		reg[pc->adr1] /= reg[pc->adr2];
+	    pc++;
+	    NEXT;
+
+	CASE(mdl):
+	    if (ZEROONE(reg[pc->adr2])) {
+		if (!reg[pc->adr2]) {
+		    status = SYRECI_DIVIDE;
+		    goto stop;
+		}
+		reg[pc->adr1] = 0;
+	    } else
+		reg[pc->adr1] %= reg[pc->adr2];
+	    pc++;
+	    NEXT;
+
+	CASE(eql):
+	    reg[pc->adr1] = reg[pc->adr1] == reg[pc->adr2];
+	    pc++;
+	    NEXT;
+
+	CASE(neq):
+	    reg[pc->adr1] = reg[pc->adr1] != reg[pc->adr2];
+	    pc++;
+	    NEXT;
+
+	CASE(gtr):
+	    reg[pc->adr1] = reg[pc->adr1] > reg[pc->adr2];
+	    pc++;
+	    NEXT;
+
+	CASE(geq):
+	    reg[pc->adr1] = reg[pc->adr1] >= reg[pc->adr2];
+	    pc++;
+	    NEXT;
+
+	CASE(lss):
+	    reg[pc->adr1] = reg[pc->adr1] < reg[pc->adr2];
+	    pc++;
+	    NEXT;
+
+	CASE(leq):
+	    reg[pc->adr1] = reg[pc->adr1] <= reg[pc->adr2];
+	    pc++;
+	    NEXT;
+
+	CASE(orr):
+	    reg[pc->adr1] = reg[pc->adr1] == 1 || reg[pc->adr2] == 1;
+	    pc++;
+	    NEXT;
+
+	CASE(neg):
+	    reg[pc->adr1] = 1 - reg[pc->adr1];
+	    pc++;
+	    NEXT;
+
+	CASE(loadglobl):
+	    reg[pc->adr1] = stack[pc->adr2];
+	    pc++;
+	    NEXT;
+
+	CASE(loadlocal):
+	    reg[pc->adr1] = stack[pc->adr2 + baseregister];
+	    pc++;
+	    NEXT;
+
+	CASE(loadimmed):
+	    reg[pc->adr1] = pc->adr2;
+	    pc++;
+	    NEXT;
+
+	CASE(storglobl):
+	    stack[pc->adr1] = reg[pc->adr2];
+	    pc++;
+	    NEXT;
+
+	CASE(storlocal):
+	    stack[pc->adr1 + baseregister] = reg[pc->adr2];
+	    pc++;
+	    NEXT;
+
+	CASE(writebool):
+	    putbool(vm, reg[pc->adr2]);
+	    pc++;
+	    NEXT;
+
+	CASE(writeint):
+	    putint(vm, reg[pc->adr2]);
+	    pc++;
+	    NEXT;
+
+	/*
+	    The calls of a program of which verify bounded the depth of the
+	    stack go to do_bounded, that does not check for overflow. With
+	    SYRECI_MEMO the calls of cached procedures go to do_memo first,
+	    and the returns to do_memoret.
+	*/
+	CASE(cal):
+	    if (!threaded && memoof && memoof[pc->adr1] &&
+		cached(vm, pc->adr1, stack, stacktop)) {
+		pc++;
+		NEXT;
+	    }
+	    if ((threaded || !bounded) && stacktop + pc->adr2 > maxstack) {
+		status = SYRECI_OVERFLOW;
+		goto stop;
+	    }
+#if threaded
+	    /* fall through */
+
+	do_bounded:
+#endif
+	    stack[stacktop + 1] = baseregister;
+	    stack[stacktop + 2] = pc + 1 - code;
+	    baseregister = stacktop;
+	    stacktop += pc->adr2;
+	    pc = &code[pc->adr1];
+	    NEXT;
+
+	CASE(ret):
+	    if (!threaded && memoof && vm->npending &&
+		vm->pending[vm->npending - 1].base == baseregister)
+		keep(vm, stack);
+	    stacktop = baseregister;
+	    baseregister = stack[stacktop + 1];
+	    pc = &code[stack[stacktop + 2]];
+	    NEXT;
+
+	CASE(jmp):
+	    pc = &code[pc->adr1];
+	    NEXT;
+
+	CASE(jiz):
+	    if (reg[pc->adr2] == 0)
+		pc = &code[pc->adr1];
+	    else
+		pc++;
+	    NEXT;
+
+	CASE(hlt):
+	    if (pairstats)
+		report(stderr);
+	    status = SYRECI_HALT;
+	    goto stop;
+
+	CASE(addimmed):
+	    reg[pc->adr1] = WRAP(reg[pc->adr1], +, pc->adr2);
+	    pc++;
+	    NEXT;
+
+	CASE(addglobl):
+	    reg[pc->adr1] = WRAP(reg[pc->adr1], +, stack[pc->adr2]);
+	    pc++;
+	    NEXT;
+
+	CASE(addlocal):
+	    reg[pc->adr1] = WRAP(reg[pc->adr1], +, stack[pc->adr2 + baseregister]);
+	    pc++;
+	    NEXT;
+
+	CASE(setglobl):
+	    stack[pc->adr1] = pc->adr2;
+	    pc++;
+	    NEXT;
+
+	CASE(setlocal):
+	    stack[pc->adr1 + baseregister] = pc->adr2;
+	    pc++;
+	    NEXT;
+
+	CASE(incglobl):
+	    stack[pc->adr1] = WRAP(stack[pc->adr1], +, pc->adr2);
+	    pc++;
+	    NEXT;
+
+	CASE(inclocal):
+	    stack[pc->adr1 + baseregister] =
+		WRAP(stack[pc->adr1 + baseregister], +, pc->adr2);
+	    pc++;
+	    NEXT;
+
+	CASE(jeql):
+	    if (reg[LEFT(pc->adr2)] == reg[RIGHT(pc->adr2)])
+		pc = &code[pc->adr1];
+	    else
+		pc++;
+	    NEXT;
+
+	CASE(jneq):
+	    if (reg[LEFT(pc->adr2)] != reg[RIGHT(pc->adr2)])
+		pc = &code[pc->adr1];
+	    else
+		pc++;
+	    NEXT;
+
+	CASE(jgtr):
+	    if (reg[LEFT(pc->adr2)] > reg[RIGHT(pc->adr2)])
+		pc = &code[pc->adr1];
+	    else
+		pc++;
+	    NEXT;
+
+	CASE(jgeq):
+	    if (reg[LEFT(pc->adr2)] >= reg[RIGHT(pc->adr2)])
+		pc = &code[pc->adr1];
+	    else
+		pc++;
+	    NEXT;
+
+	CASE(jlss):
+	    if (reg[LEFT(pc->adr2)] < reg[RIGHT(pc->adr2)])
+		pc = &code[pc->adr1];
+	    else
+		pc++;
+	    NEXT;
+
+	CASE(jleq):
+	    if (reg[LEFT(pc->adr2)] <= reg[RIGHT(pc->adr2)])
+		pc = &code[pc->adr1];
+	    else
+		pc++;
+	    NEXT;
+
+	CASE(loadconst):
+	    reg[pc->adr1] = pool[pc->adr2];
+	    pc++;
+	    NEXT;
+
+	CASE(mov):
+	    reg[pc->adr1] = reg[pc->adr2];
+	    pc++;
+	    NEXT;
+#if threaded
+
+	tick:
+	    if (left <= 0) {
+		status = SYRECI_BUDGET;
+		goto stop;
+	    }
+	    left -= blocks[pc - code];
+	    goto *stubs[pc - code];
+
+	count:
+	    counts[pc - code]++;
+	    goto *handlers[pc - code];
+
+	track:
+	    current = pc;
+	    goto *handlers[pc - code];
+
+	event:
+	    counts[pc - code]++;
+	    measure(vm, &image[pc - code]);
+	    goto *handlers[pc - code];
+
+	do_memo:
+	    if (cached(vm, pc->adr1, stack, stacktop)) {
+		pc++;
+		NEXT;
+	    }
+	    goto do_cal;
+
+	do_memoret:
+	    if (vm->npending &&
+		vm->pending[vm->npending - 1].base == baseregister)
+		keep(vm, stack);
+	    goto do_ret;
+#endif
+#if !threaded
+	default:
+#ifdef _MSC_VER
+	    __assume(0);
+#else
+	    __builtin_unreachable();
+#endif
+	}
+    }
+#endif
+stop:
+#ifndef _WIN32
+    if (vm->options & SYRECI_SAMPLE)
+	stopsampling();
+#endif
+    if (counting && status == SYRECI_BUDGET)
+	credit(vm);
+    vm->pc = pc - code;
+    vm->stacktop = stacktop;
+    vm->baseregister = baseregister;
+    memcpy(vm->reg, reg, sizeof(reg));
+    if (vm->ticked)
+	vm->executed += limit - left;
+    vm->stopped = status != SYRECI_BUDGET;
+    flush(vm);
+    return vm->status = status;
+}
+
+/*
+    unload frees the program and what was made for it.
+*/
+static void unload(syreci *vm)
+{
+    if (vm->mapped)
+	syreci_unmap(vm->file, vm->size);
+    else if (!vm->borrowed)
+	free(vm->file);
+#if jitted
+    if (vm->native) {
+	munmap((void *)vm->native, vm->nativesize);
+	free(vm->table);
+    }
+    vm->native = 0;
+    vm->table = 0;
+#endif
+    free(vm->code);
+    free(vm->handlers);
+    free(vm->stubs);
+    free(vm->leader);
+    free(vm->blocks);
+    free(vm->counts);
+    free(vm->samples);
+    free(vm->perproc);
+    free(vm->procstack);
+    free(vm->trusted);
+    free(vm->memos);
+    free(vm->memoof);
+    free(vm->cache);
+    free(vm->pending);
+    vm->file = 0;
+    vm->mapped = vm->borrowed = false;
+    vm->lines = 0;
+    vm->pure = 0;
+    vm->trusted = 0;
+    vm->code = 0;
+    vm->handlers = vm->stubs = 0;
+    vm->leader = 0;
+    vm->blocks = vm->counts = vm->samples = 0;
+    vm->perproc = 0;
+    vm->procstack = 0;
+    vm->memos = 0;
+    vm->memoof = 0;
+    vm->cache = 0;
+    vm->pending = 0;
+    vm->nmemos = vm->npending = 0;
+    vm->translated = vm->ticked = false;
+    vm->status = SYRECI_EMPTY;
+}
+
+/*
+    prepare checks the file that was loaded and makes what the options ask
+    for.
+*/
+static syreci_status prepare(syreci *vm, int options)
+{
+    header *hdr = (header *)vm->file;
+    syreci_status status;
+    size_t length, extra;
+    uint32_t i, size;
+    bool profilers = options & (SYRECI_PROFILE | SYRECI_SAMPLE |
+				SYRECI_EVENTS);
+
+    if (vm->size < sizeof(header) ||
+	memcmp(hdr->magic, MAGIC, sizeof(hdr->magic)) ||
+	hdr->version != VERSION) {
+	unload(vm);
+	return SYRECI_VERSION;
+    }
+    length = sizeof(header) + (size_t)hdr->codesize * sizeof(instruction) +
+	     (size_t)hdr->poolsize * sizeof(int64_t);
+    if (hdr->codesize >= 2 && vm->size > length &&
+	(vm->pure = getpure(vm->file + length, vm->size - length,
+			    hdr->codesize, &extra)) != 0)
+	length += extra;
+    if (hdr->codesize < 2 || vm->size < length || (vm->size > length &&
+	(vm->lines = getlines(vm->file + length, vm->size - length,
+			      hdr->codesize)) == 0)) {
+	unload(vm);
+	return SYRECI_SIZE;
+    }
+    if ((options & SYRECI_SAMPLE) && !vm->lines) {
+	unload(vm);
+	return SYRECI_NOLINES;
+    }
+    vm->options = options;
+    vm->hdr = hdr;
+    vm->image = (instruction *)(hdr + 1);
+    vm->pool = (int64_t *)(vm->image + hdr->codesize);
+    if ((status = verify(vm)) != SYRECI_OK) {
+	unload(vm);
+	return status;
+    }
+    size = hdr->codesize;
+    if (showcode)
+	for (i = 1; i < size; i++)
+	    debug(vm, &vm->image[i], vm->image);
+    if (((options & (SYRECI_PROFILE | SYRECI_EVENTS)) &&
+	 (vm->counts = calloc(size, sizeof(int64_t))) == 0) ||
+	((options & SYRECI_SAMPLE) &&
+	 (vm->samples = calloc(size, sizeof(int64_t))) == 0) ||
+	((options & SYRECI_EVENTS) &&
+	 ((vm->perproc = calloc((size_t)size * maxevent,
+				sizeof(uint64_t))) == 0 ||
+	  (vm->procstack = calloc(maxstack + 1, sizeof(uint32_t))) == 0 ||
+	  (vm->leader = leaders(vm->image, size)) == 0)) ||
+	((options & SYRECI_MEMO) && !memoize(vm))) {
+	unload(vm);
+	return SYRECI_MEMORY;
+    }
+#if threaded
+    if ((vm->code = malloc(size * sizeof(code_t))) == 0 || (profilers &&
+	(vm->handlers = malloc(size * sizeof(void *))) == 0)) {
+	unload(vm);
+	return SYRECI_MEMORY;
+    }
+#endif
+#if jitted
+    if ((options & SYRECI_JIT) && !profilers && !(options & SYRECI_MEMO))
+	compile(vm);
+#endif
+    syreci_reset(vm);
+    return SYRECI_OK;
+}
+
+void *syreci_map(const char *filename, size_t *size)
+{
+    return load(filename, size);
+}
+
+void syreci_unmap(void *file, size_t size)
+{
+#ifndef _WIN32
+    munmap(file, size);
+#else
+    free(file);
+#endif
+}
+
+static int64_t *newstack(void)
+{
+    int i;
+    stackblock *stack;
+
+    if (!freestacks) {
+	if ((stack = malloc(chunksize * sizeof(stackblock))) == 0)
+	    return 0;
+	for (i = 0; i < chunksize; i++) {
+	    stack[i].next = freestacks;
+	    freestacks = &stack[i];
+	}
+    }
+    stack = freestacks;
+    freestacks = stack->next;
+    return stack->slot;
+}
+
+static void freestack(int64_t *slot)
+{
+    stackblock *stack = (stackblock *)slot;
+
+    stack->next = freestacks;
+    freestacks = stack;
+}
+
+syreci *syreci_create(void)
+{
+    syreci *vm;
+
+    if ((vm = calloc(1, sizeof(syreci))) == 0)
+	return 0;
+    if ((vm->stack = newstack()) == 0) {
+	free(vm);
+	return 0;
+    }
+    vm->outbuf = vm->line;
+    vm->outmax = outline;
+    vm->status = SYRECI_EMPTY;
+    return vm;
+}
+
+void syreci_destroy(syreci *vm)
+{
+    if (!vm)
+	return;
+    unload(vm);
+    freestack(vm->stack);
+    if (vm->outbuf != vm->line)
+	free(vm->outbuf);
+    free(vm);
+}
+
+/*
+    loaded keeps the message of a load that failed for syreci_error; verify
+    leaves a more precise one.
+*/
+static syreci_status loaded(syreci *vm, syreci_status status)
+{
+    if (status != SYRECI_INVALID)
+	snprintf(vm->diagnostic, sizeof(vm->diagnostic), "%s",
+		 status == SYRECI_OK ? "" : syreci_message(status));
+    return status;
+}
+
+syreci_status syreci_load(syreci *vm, const char *filename, int options)
+{
+    unload(vm);
+    if ((vm->file = syreci_map(filename, &vm->size)) == 0)
+	return loaded(vm, SYRECI_NOFILE);
+    vm->mapped = true;
+    return loaded(vm, prepare(vm, options));
+}
+
+syreci_status syreci_loadimage(syreci *vm, const void *image, size_t size,
+			       int options)
+{
+    unload(vm);
+    vm->file = (char *)image;
+    vm->size = size;
+    vm->borrowed = true;
+    return loaded(vm, prepare(vm, options));
+}
+
+syreci_status syreci_loadbuffer(syreci *vm, const void *buf, size_t size,
+				int options)
+{
+    unload(vm);
+    if ((vm->file = malloc(size ? size : 1)) == 0)
+	return loaded(vm, SYRECI_MEMORY);
+    memcpy(vm->file, buf, size);
+    vm->size = size;
+    return loaded(vm, prepare(vm, options));
+}
+
+void syreci_output(syreci *vm, syreci_writer writer, void *context,
+		   bool eachline)
+{
+    flush(vm);
+    vm->writer = writer;
+    vm->context = context;
+    vm->eachline = eachline;
+    vm->outlimit = eachline ? 0 : vm->outmax - outline;
+}
+
+syreci_status syreci_run(syreci *vm, int64_t budget)
+{
+#if jitted
+    uint32_t i;
+#endif
+
+    if (!vm->file)
+	return SYRECI_EMPTY;
+    if (vm->stopped)
+	return vm->status;
+#if jitted
+    if (vm->native && !budget && !vm->started) {
+	vm->started = vm->stopped = true;
+	vm->pc = i = vm->native(vm, vm->stack);
+	flush(vm);
+	return vm->status = vm->image[i].op == cal ? SYRECI_OVERFLOW :
+			    vm->image[i].op == hlt ? SYRECI_HALT :
+			    SYRECI_DIVIDE;
+    }
+#endif
+    return execute(vm, budget);
+}
+
+void syreci_reset(syreci *vm)
+{
+    uint32_t i, size;
+
+    if (!vm->file)
+	return;
+    size = vm->hdr->codesize;
+    vm->pc = 1;
+    vm->stacktop = vm->baseregister = 0;
+    memset(vm->reg, 0, sizeof(vm->reg));
+    memset(vm->stack, 0, (maxstack + 1) * sizeof(int64_t));
+    vm->executed = 0;
+    vm->started = vm->stopped = false;
+    vm->status = SYRECI_BUDGET;
+    vm->proctop = 0;
+    if (vm->procstack)
+	vm->procstack[0] = 0;
+    if (vm->counts)
+	memset(vm->counts, 0, size * sizeof(int64_t));
+    if (vm->samples)
+	memset(vm->samples, 0, size * sizeof(int64_t));
+    if (vm->perproc)
+	memset(vm->perproc, 0, (size_t)size * maxevent * sizeof(uint64_t));
+    vm->npending = 0;
+    if (vm->cache)
+	memset(vm->cache, 0, memosize * (1 + 2 * maxkey) * sizeof(int64_t));
+    for (i = 0; i < vm->nmemos; i++)
+	vm->memos[i].hits = vm->memos[i].misses = 0;
+}
+
+uint32_t syreci_pc(syreci *vm)
+{
+    return vm->pc;
+}
+
+int64_t syreci_executed(syreci *vm)
+{
+    return vm->executed;
+}
+
+const char *syreci_error(syreci *vm)
+{
+    return vm->diagnostic;
+}
+
+/*
+    hash is the FNV-1a hash of the header, the instructions and the pool of
+    the program; the line table is left out.
+*/
+static uint64_t hash(syreci *vm)
+{
+    unsigned char *ptr = (unsigned char *)vm->hdr,
+		  *end = (unsigned char *)(vm->pool + vm->hdr->poolsize);
+    uint64_t h = 14695981039346656037ULL;
+
+    for (; ptr < end; ptr++)
+	h = (h ^ *ptr) * 1099511628211ULL;
+    return h;
+}
+
+syreci_status syreci_save(syreci *vm, const char *filename)
+{
+    FILE *fp;
+    snapshot snap;
+    bool ok;
+
+    if (!vm->file)
+	return SYRECI_EMPTY;
+    memset(&snap, 0, sizeof(snap));
+    memcpy(snap.magic, SNAPMAGIC, sizeof(snap.magic));
+    snap.version = VERSION;
+    snap.pc = vm->pc;
+    snap.status = vm->status;
+    snap.hash = hash(vm);
+    snap.executed = vm->executed;
+    snap.stacktop = vm->stacktop;
+    snap.baseregister = vm->baseregister;
+    memcpy(snap.reg, vm->reg, sizeof(snap.reg));
+    if ((fp = fopen(filename, "wb")) == 0)
+	return SYRECI_NOSAVE;
+    ok = fwrite(&snap, sizeof(snap), 1, fp) == 1 &&
+	 fwrite(vm->stack, sizeof(int64_t), vm->stacktop + 1, fp) ==
+	 (size_t)vm->stacktop + 1;
+    if (fclose(fp) || !ok) {
+	remove(filename);
+	return SYRECI_NOSAVE;
+    }
+    return SYRECI_OK;
+}
+
+/*
+    frames tells whether the stack of a snapshot holds frames that the program
+    can make: from base down to the frame of main at 0, each return link
+    follows a CAL, the base below is lower, and each frame ends where the one
+    above it starts, at the size that its CAL gives. The interpreter does not
+    check the links when it returns, so a bad one must not get that far.
+*/
+static bool frames(syreci *vm, const int64_t *stack, int64_t top, int64_t base)
+{
+    instruction *call;
+    int64_t link, below;
+
+    for (; base > 0; top = base, base = below) {
+	if (base + 2 > top)
+	    return false;
+	link = stack[base + 2];
+	below = stack[base + 1];
+	if (link < 2 || link >= vm->hdr->codesize || below < 0 ||
+	    below >= base)
+	    return false;
+	call = &vm->image[link - 1];
+	if (call->op != cal || top != base + call->adr2)
+	    return false;
+    }
+    /* main runs in the frame of the CAL at 1, its links hold globals */
+    call = &vm->image[1];
+    return top == 0 || (call->op == cal && top == call->adr2);
+}
+
+syreci_status syreci_restore(syreci *vm, const char *filename)
+{
+    char *file;
+    size_t size;
+    snapshot *snap;
+
+    if (!vm->file)
+	return SYRECI_EMPTY;
+    if ((file = syreci_map(filename, &size)) == 0)
+	return SYRECI_NOFILE;
+    snap = (snapshot *)file;
+    if (size < sizeof(snapshot) ||
+	memcmp(snap->magic, SNAPMAGIC, sizeof(snap->magic)) ||
+	snap->version != VERSION || snap->hash != hash(vm) ||
+	snap->status < SYRECI_HALT || snap->status > SYRECI_DIVIDE ||
+	snap->pc == 0 || snap->pc >= vm->hdr->codesize ||
+	snap->stacktop < 0 || snap->stacktop > maxstack ||
+	snap->baseregister < 0 || snap->baseregister > snap->stacktop ||
+	size != sizeof(snapshot) + (snap->stacktop + 1) * sizeof(int64_t) ||
+	!frames(vm, (int64_t *)(snap + 1), snap->stacktop,
+		snap->baseregister)) {
+	syreci_unmap(file, size);
+	return SYRECI_SNAPSHOT;
+    }
+    syreci_reset(vm);
+    vm->pc = snap->pc;
+    vm->executed = snap->executed;
+    vm->stacktop = snap->stacktop;
+    vm->baseregister = snap->baseregister;
+    memcpy(vm->reg, snap->reg, sizeof(vm->reg));
+    memcpy(vm->stack, snap + 1, (snap->stacktop + 1) * sizeof(int64_t));
+    vm->started = true;
+    vm->status = snap->status;
+    vm->stopped = vm->status != SYRECI_BUDGET;
+    syreci_unmap(file, size);
+    return SYRECI_OK;
+}
+
+const char *syreci_message(syreci_status status)
+{
+    static const char *messages[] = {
+	[SYRECI_OK] = "loaded",
+	[SYRECI_HALT] = "halted",
+	[SYRECI_BUDGET] = "budget used",
+	[SYRECI_OVERFLOW] = "stack overflow",
+	[SYRECI_DIVIDE] = "division by zero",
+	[SYRECI_NOFILE] = "cannot load",
+	[SYRECI_VERSION] = "not a version " VALUE(VERSION) " bytecode file",
+	[SYRECI_SIZE] = "file size does not match header",
+	[SYRECI_NOLINES] = "no line table, compile with -g",
+	[SYRECI_MEMORY] = "out of memory",
+	[SYRECI_EMPTY] = "no program loaded",
+	[SYRECI_NOSAVE] = "cannot write snapshot",
+	[SYRECI_SNAPSHOT] = "not a snapshot of this program",
+	[SYRECI_INVALID] = "bytecode does not verify"
+    };
+
+    if ((unsigned)status >= sizeof(messages) / sizeof(messages[0]))
+	return "unknown status";
+    return messages[status];
+}
+
+void syreci_report(syreci *vm, FILE *fp)
+{
+    if (!vm->file)
+	return;
+    if (vm->options & SYRECI_PROFILE)
+	hotspots(vm->image, vm->hdr->codesize, vm->counts, fp);
+    if (vm->options & SYRECI_EVENTS)
+	events(vm, fp);
+    if (vm->options & SYRECI_SAMPLE)
+	lineprofile(vm->lines, vm->hdr->codesize, vm->samples, fp);
+    if (vm->options & SYRECI_MEMO)
+	memoreport(vm, fp);
+}
+
+/* End. */
@@ -0,0 +1,141 @@
+/*
+    module  : syreci.h
+    version : 1.5
+    date    : 10/17/26
+*/
+#ifndef SYRECI_H
+#define SYRECI_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+    libsyreci runs bytecode files of 32syrecc inside another program. A syreci
+    is a virtual machine with its program, registers, stack and output; it
+    shares no state with other machines, so that many can be used at the same
+    time, also in different threads. Only the profilers, that use a signal and
+    the hardware counters of the process, can watch one machine at a time.
+*/
+typedef struct syreci syreci;
+
+/*
+    options of syreci_load; the profile options are the -p, -s and -e
+    profilers of 32syreci, and SYRECI_MEMO is -k, that all report with
+    syreci_report. SYRECI_MEMO keeps the results of the calls of the pure
+    procedures in the table of the bytecode file in a cache, and answers
+    later calls with the same key from the cache; the JIT is not used then.
+*/
+#define SYRECI_JIT	1	/* translate to native code, on x86-64 */
+#define SYRECI_PROFILE	2	/* count the instructions */
+#define SYRECI_SAMPLE	4	/* sample the source lines */
+#define SYRECI_EVENTS	8	/* read the hardware counters */
+#define SYRECI_MEMO	16	/* cache the calls of pure procedures */
+
+typedef enum syreci_status {
+    SYRECI_OK,		/* the program is loaded */
+    SYRECI_HALT,	/* the program halted */
+    SYRECI_BUDGET,	/* the budget is used; syreci_run continues */
+    SYRECI_OVERFLOW,	/* stack overflow */
+    SYRECI_DIVIDE,	/* division by zero */
+    SYRECI_NOFILE,	/* the file cannot be read */
+    SYRECI_VERSION,	/* not a bytecode file of this version */
+    SYRECI_SIZE,	/* the size does not match the header */
+    SYRECI_NOLINES,	/* sampling needs a line table */
+    SYRECI_MEMORY,	/* out of memory */
+    SYRECI_EMPTY,	/* no program is loaded */
+    SYRECI_NOSAVE,	/* the snapshot cannot be written */
+    SYRECI_SNAPSHOT,	/* not a snapshot of the loaded program */
+    SYRECI_INVALID	/* the bytecode does not verify */
+} syreci_status;
+
+/*
+    A writer receives the output of the program, size characters at buf.
+*/
+typedef void (*syreci_writer)(void *context, const char *buf, size_t size);
+
+syreci *syreci_create(void);
+void syreci_destroy(syreci *vm);
+
+/*
+    syreci_load loads a bytecode file, syreci_loadbuffer a copy of a bytecode
+    file in memory, replacing the program that was loaded before. The
+    program starts at its first instruction, with registers and stack 0. A
+    program is verified when it is loaded: one that could index outside the
+    registers, the code, the pool or the stack, or overwrite a return link,
+    is not loaded.
+*/
+syreci_status syreci_load(syreci *vm, const char *filename, int options);
+syreci_status syreci_loadbuffer(syreci *vm, const void *buf, size_t size,
+				int options);
+
+/*
+    syreci_map maps a bytecode file read-only, to be shared by the machines
+    that load it with syreci_loadimage; syreci_loadimage uses the image in
+    place, so it must stay unchanged until the machine loads another program
+    or is destroyed.
+*/
+void *syreci_map(const char *filename, size_t *size);
+void syreci_unmap(void *file, size_t size);
+syreci_status syreci_loadimage(syreci *vm, const void *image, size_t size,
+			       int options);
+
+/*
+    syreci_output sends the output to writer, instead of stdout; eachline
+    passes every line when it is written, instead of a buffer at a time.
+*/
+void syreci_output(syreci *vm, syreci_writer writer, void *context,
+		   bool eachline);
+
+/*
+    syreci_run runs the program until it halts or fails, or, if budget is not
+    0, until about budget instructions have been executed: the machine stops
+    at the start of the first basic block after that. The output is passed to
+    the writer before syreci_run returns.
+*/
+syreci_status syreci_run(syreci *vm, int64_t budget);
+
+/*
+    syreci_reset restarts the program, as syreci_load left it.
+*/
+void syreci_reset(syreci *vm);
+
+/*
+    syreci_pc is the index of the instruction that executes next, or that
+    failed.
+*/
+uint32_t syreci_pc(syreci *vm);
+
+/*
+    syreci_executed is the number of instructions executed in runs with a
+    budget, since the program was loaded or reset.
+*/
+int64_t syreci_executed(syreci *vm);
+
+/*
+    syreci_save writes the registers, the stack and the pc of the machine to a
+    snapshot file, between runs. syreci_restore continues the loaded program
+    from a snapshot of it, made by this or another process, so that its next
+    run starts where the run before the snapshot stopped; the profilers start
+    again from 0. A restored program does not use the JIT.
+*/
+syreci_status syreci_save(syreci *vm, const char *filename);
+syreci_status syreci_restore(syreci *vm, const char *filename);
+
+const char *syreci_message(syreci_status status);
+
+/*
+    syreci_error describes why the last load failed; when the program does
+    not verify, it names the instruction and what is wrong with it.
+*/
+const char *syreci_error(syreci *vm);
+
+/*
+    syreci_report prints the reports of the profilers selected in
+    syreci_load to fp, and with SYRECI_MEMO the hits and misses of the cache
+    for each pure procedure.
+*/
+void syreci_report(syreci *vm, FILE *fp);
+
+#endif
@@ -0,0 +1,89 @@
+#!/bin/sh
+#
+#   module  : test.sh
+#   version : 1.3
+#   date    : 10/17/26
+#
+#   Runs the regression tests: each test/*.inp is compiled at -O0, -O1 and
+#   -O2 and run by 32syreci, plain, with -j and with -k, also through the
+#   listing and dump, and translated to C and compiled with CC; the output
+#   must be test/*.out, without the PC of a program that is aborted. A
+#   test/*.bad program must not compile: 32syreci reports it, and with -b it
+#   still runs the other programs. dump must not write a file from a listing
+#   with an operand out of range. A snapshot taken inside test/recurse.inp
+#   must continue to its output, and be refused once a return link in it is
+#   overwritten. Run from the top directory, after make.
+#
+CC=${CC:-cc}
+TMP=${TMPDIR:-/tmp}/test.$$
+failed=0
+
+mkdir -p $TMP
+trap 'rm -rf $TMP' 0
+
+# check name what: compares $TMP/name.out with test/name.out
+check() {
+    sed 's/, PC=[0-9]*//' $TMP/$1.out | cmp -s - test/$1.out ||
+	fail $1 "$2"
+}
+
+# fail name reason
+fail() {
+    echo "FAIL $1: $2"
+    failed=1
+}
+
+for src in test/*.inp; do
+    name=$(basename $src .inp)
+    for level in -O0 -O1 -O2; do
+	if ! ./32syrecc $level -o $TMP/$name.bin $src; then
+	    fail $name "32syrecc $level"
+	    continue
+	fi
+	for option in "" -j -k; do
+	    ./32syreci $option $TMP/$name.bin >$TMP/$name.out 2>/dev/null
+	    check $name "32syrecc $level, 32syreci $option"
+	done
+	./32syrecc $level $src | ./dump $TMP/$name.bin &&
+	    ./32syreci $TMP/$name.bin >$TMP/$name.out 2>/dev/null
+	check $name "32syrecc $level | dump"
+	./32syrecc $level -c $src >$TMP/$name.c &&
+	    $CC -o $TMP/$name $TMP/$name.c || {
+	    fail $name "32syrecc $level -c"
+	    continue
+	}
+	(echo "SYRECI ..."; $TMP/$name) >$TMP/$name.out 2>/dev/null
+	check $name "32syrecc $level -c"
+    done
+done
+for src in test/*.bad; do
+    name=$(basename $src .bad)
+    cp $src $TMP/$name.inp
+    ./32syrecc $TMP/$name.inp >/dev/null 2>&1 &&
+	fail $name "32syrecc compiles it"
+    ./32syreci $TMP/$name.inp >/dev/null 2>$TMP/$name.err &&
+	fail $name "32syreci runs it"
+    grep -q "(cannot compile)" $TMP/$name.err ||
+	fail $name "32syreci does not report it"
+    ./32syreci -b $TMP/$name.inp test/unreachable.inp >$TMP/$name.out \
+	2>/dev/null
+    cmp -s $TMP/$name.out test/unreachable.out ||
+	fail $name "32syreci -b stops the other programs"
+done
+rm -f $TMP/bad.bin
+printf '1 CAL 3 2\n2 JMP -5 0\n3 HLT 0 0\n' | ./dump $TMP/bad.bin 2>/dev/null &&
+    fail dump "accepts an operand out of range"
+[ -f $TMP/bad.bin ] && fail dump "writes a file without the bad instruction"
+./32syrecc -o $TMP/recurse.bin test/recurse.inp &&
+    ./32syreci -c $TMP/recurse.snap -n 200 $TMP/recurse.bin >/dev/null &&
+    ./32syreci -r $TMP/recurse.snap $TMP/recurse.bin >$TMP/recurse.out \
+	2>/dev/null
+check recurse "32syreci -r"
+set -- $(od -A n -t d8 -j 32 -N 16 $TMP/recurse.snap)
+size=$(wc -c <$TMP/recurse.snap)
+printf '\377\377\377\377\377\377\377\377' | dd of=$TMP/recurse.snap bs=1 \
+    seek=$((size - ($1 + 1) * 8 + ($2 + 2) * 8)) conv=notrunc 2>/dev/null
+./32syreci -r $TMP/recurse.snap $TMP/recurse.bin 2>&1 >/dev/null |
+    grep -q "not a snapshot" || fail recurse "32syreci -r takes a bad link"
+[ $failed = 0 ] && echo "all tests passed"
+exit $failed